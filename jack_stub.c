@@ -0,0 +1,395 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: JACK stand-in for offline tools
+ *
+ * Minimal in-process implementation of the JACK API used by
+ * ZynMidiRouter: ports with MIDI buffers, connections, ring-buffers
+ * and process-callback driving. No jackd needed.
+ *
+ * Copyright (C) 2015-2024 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+#include <jack/ringbuffer.h>
+
+#include "jack_stub.h"
+
+//-----------------------------------------------------------------------------
+// Data Structures
+//-----------------------------------------------------------------------------
+
+struct jack_stub_midi_event_st {
+	jack_nframes_t time;
+	uint32_t size;
+	uint32_t offset;
+};
+
+struct jack_stub_midi_buffer_st {
+	jack_nframes_t nframes;
+	uint32_t n_events;
+	uint32_t data_used;
+	uint32_t lost;
+	struct jack_stub_midi_event_st events[JACK_STUB_MAX_EVENTS];
+	jack_midi_data_t data[JACK_STUB_DATA_SIZE];
+};
+
+struct _jack_port {
+	char name[64];
+	unsigned long flags;
+	jack_port_id_t id;
+	int connections;
+	struct jack_stub_midi_buffer_st buffer;
+};
+
+struct _jack_client {
+	char name[32];
+	int active;
+	JackProcessCallback process_cb;
+	void *process_arg;
+	JackBufferSizeCallback buffer_size_cb;
+	void *buffer_size_arg;
+	JackPortConnectCallback connect_cb;
+	void *connect_arg;
+};
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+struct _jack_client jack_stub_client;
+jack_port_t *jack_stub_ports[JACK_STUB_MAX_PORTS];
+int jack_stub_num_ports = 0;
+jack_nframes_t jack_stub_nframes = 256;
+jack_nframes_t jack_stub_srate = 48000;
+jack_nframes_t jack_stub_frame_time = 0;		// Frame time at the start of current cycle
+
+//-----------------------------------------------------------------------------
+// Stand-in control
+//-----------------------------------------------------------------------------
+
+void jack_stub_set_buffer_size(jack_nframes_t nframes) {
+	jack_stub_nframes = nframes;
+}
+
+void jack_stub_set_sample_rate(jack_nframes_t srate) {
+	jack_stub_srate = srate;
+}
+
+void jack_stub_connect(jack_port_t *port, int connections) {
+	port->connections = connections;
+	if (jack_stub_client.connect_cb)
+		jack_stub_client.connect_cb(port->id, port->id, connections > 0, jack_stub_client.connect_arg);
+}
+
+int jack_stub_midi_in(jack_port_t *port, jack_nframes_t time, const uint8_t *data, size_t size) {
+	port->buffer.nframes = jack_stub_nframes;
+	return jack_midi_event_write(&port->buffer, time, data, size);
+}
+
+int jack_stub_cycle() {
+	int res = 0;
+	if (jack_stub_client.active && jack_stub_client.process_cb)
+		res = jack_stub_client.process_cb(jack_stub_nframes, jack_stub_client.process_arg);
+	for (int i = 0; i < jack_stub_num_ports; i++) {
+		if (jack_stub_ports[i] && (jack_stub_ports[i]->flags & JackPortIsInput))
+			jack_midi_clear_buffer(&jack_stub_ports[i]->buffer);
+	}
+	jack_stub_frame_time += jack_stub_nframes;
+	return res;
+}
+
+void jack_stub_set_frame_time(jack_nframes_t frame_time) {
+	jack_stub_frame_time = frame_time;
+}
+
+jack_nframes_t jack_stub_get_frame_time() {
+	return jack_stub_frame_time;
+}
+
+uint32_t jack_stub_get_lost_events(jack_port_t *port) {
+	return port->buffer.lost;
+}
+
+//-----------------------------------------------------------------------------
+// Client & Ports
+//-----------------------------------------------------------------------------
+
+jack_client_t *jack_client_open(const char *client_name, jack_options_t options, jack_status_t *status, ...) {
+	memset(&jack_stub_client, 0, sizeof(jack_stub_client));
+	snprintf(jack_stub_client.name, sizeof(jack_stub_client.name), "%s", client_name);
+	return &jack_stub_client;
+}
+
+int jack_client_close(jack_client_t *client) {
+	client->active = 0;
+	for (int i = 0; i < jack_stub_num_ports; i++)
+		free(jack_stub_ports[i]);
+	jack_stub_num_ports = 0;
+	return 0;
+}
+
+int jack_activate(jack_client_t *client) {
+	if (client->buffer_size_cb)
+		client->buffer_size_cb(jack_stub_nframes, client->buffer_size_arg);
+	client->active = 1;
+	return 0;
+}
+
+jack_port_t *jack_port_register(jack_client_t *client, const char *port_name, const char *port_type, unsigned long flags, unsigned long buffer_size) {
+	if (jack_stub_num_ports >= JACK_STUB_MAX_PORTS)
+		return NULL;
+	jack_port_t *port = calloc(1, sizeof(struct _jack_port));
+	if (!port)
+		return NULL;
+	snprintf(port->name, sizeof(port->name), "%s:%s", client->name, port_name);
+	port->flags = flags;
+	port->id = jack_stub_num_ports;
+	port->buffer.nframes = jack_stub_nframes;
+	jack_stub_ports[jack_stub_num_ports++] = port;
+	return port;
+}
+
+int jack_port_unregister(jack_client_t *client, jack_port_t *port) {
+	if (!port || port->id >= jack_stub_num_ports || jack_stub_ports[port->id] != port)
+		return -1;
+	jack_stub_ports[port->id] = NULL;
+	free(port);
+	return 0;
+}
+
+void *jack_port_get_buffer(jack_port_t *port, jack_nframes_t nframes) {
+	if (!port)
+		return NULL;
+	port->buffer.nframes = nframes;
+	return &port->buffer;
+}
+
+int jack_port_connected(const jack_port_t *port) {
+	return port ? port->connections : 0;
+}
+
+int jack_set_process_callback(jack_client_t *client, JackProcessCallback process_callback, void *arg) {
+	client->process_cb = process_callback;
+	client->process_arg = arg;
+	return 0;
+}
+
+int jack_set_buffer_size_callback(jack_client_t *client, JackBufferSizeCallback bufsize_callback, void *arg) {
+	client->buffer_size_cb = bufsize_callback;
+	client->buffer_size_arg = arg;
+	return 0;
+}
+
+int jack_set_port_connect_callback(jack_client_t *client, JackPortConnectCallback connect_callback, void *arg) {
+	client->connect_cb = connect_callback;
+	client->connect_arg = arg;
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Time
+//-----------------------------------------------------------------------------
+
+jack_nframes_t jack_get_buffer_size(jack_client_t *client) {
+	return jack_stub_nframes;
+}
+
+jack_nframes_t jack_get_sample_rate(jack_client_t *client) {
+	return jack_stub_srate;
+}
+
+jack_nframes_t jack_frame_time(const jack_client_t *client) {
+	return jack_stub_frame_time;
+}
+
+jack_nframes_t jack_last_frame_time(const jack_client_t *client) {
+	return jack_stub_frame_time;
+}
+
+//-----------------------------------------------------------------------------
+// MIDI buffers
+//-----------------------------------------------------------------------------
+
+uint32_t jack_midi_get_event_count(void *port_buffer) {
+	return ((struct jack_stub_midi_buffer_st *)port_buffer)->n_events;
+}
+
+int jack_midi_event_get(jack_midi_event_t *event, void *port_buffer, uint32_t event_index) {
+	struct jack_stub_midi_buffer_st *buf = port_buffer;
+	if (event_index >= buf->n_events)
+		return -1;
+	event->time = buf->events[event_index].time;
+	event->size = buf->events[event_index].size;
+	event->buffer = buf->data + buf->events[event_index].offset;
+	return 0;
+}
+
+void jack_midi_clear_buffer(void *port_buffer) {
+	struct jack_stub_midi_buffer_st *buf = port_buffer;
+	buf->n_events = 0;
+	buf->data_used = 0;
+	buf->lost = 0;
+}
+
+// Same rules than JACK: events must be written in time order, inside the period
+jack_midi_data_t *jack_midi_event_reserve(void *port_buffer, jack_nframes_t time, size_t data_size) {
+	struct jack_stub_midi_buffer_st *buf = port_buffer;
+	if (time >= buf->nframes || (buf->n_events > 0 && buf->events[buf->n_events - 1].time > time)
+		|| buf->n_events >= JACK_STUB_MAX_EVENTS || buf->data_used + data_size > JACK_STUB_DATA_SIZE) {
+		buf->lost++;
+		return NULL;
+	}
+	struct jack_stub_midi_event_st *ev = buf->events + buf->n_events++;
+	ev->time = time;
+	ev->size = data_size;
+	ev->offset = buf->data_used;
+	buf->data_used += data_size;
+	return buf->data + ev->offset;
+}
+
+int jack_midi_event_write(void *port_buffer, jack_nframes_t time, const jack_midi_data_t *data, size_t data_size) {
+	jack_midi_data_t *dst = jack_midi_event_reserve(port_buffer, time, data_size);
+	if (!dst)
+		return ENOBUFS;
+	memcpy(dst, data, data_size);
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
+// Ring-buffers => lock-free single reader / single writer, as JACK's ones
+//-----------------------------------------------------------------------------
+
+jack_ringbuffer_t *jack_ringbuffer_create(size_t sz) {
+	jack_ringbuffer_t *rb = malloc(sizeof(jack_ringbuffer_t));
+	if (!rb)
+		return NULL;
+	int power_of_two;
+	for (power_of_two = 1; 1 << power_of_two < sz; power_of_two++);
+	rb->size = 1 << power_of_two;
+	rb->size_mask = rb->size - 1;
+	rb->write_ptr = 0;
+	rb->read_ptr = 0;
+	rb->mlocked = 0;
+	rb->buf = malloc(rb->size);
+	if (!rb->buf) {
+		free(rb);
+		return NULL;
+	}
+	return rb;
+}
+
+void jack_ringbuffer_free(jack_ringbuffer_t *rb) {
+	if (rb->mlocked)
+		munlock(rb->buf, rb->size);
+	free(rb->buf);
+	free(rb);
+}
+
+int jack_ringbuffer_mlock(jack_ringbuffer_t *rb) {
+	if (mlock(rb->buf, rb->size))
+		return -1;
+	rb->mlocked = 1;
+	return 0;
+}
+
+size_t jack_ringbuffer_read_space(const jack_ringbuffer_t *rb) {
+	size_t w = __atomic_load_n(&rb->write_ptr, __ATOMIC_ACQUIRE);
+	size_t r = rb->read_ptr;
+	return (w - r) & rb->size_mask;
+}
+
+size_t jack_ringbuffer_write_space(const jack_ringbuffer_t *rb) {
+	size_t w = rb->write_ptr;
+	size_t r = __atomic_load_n(&rb->read_ptr, __ATOMIC_ACQUIRE);
+	return ((r - w - 1) & rb->size_mask);
+}
+
+void jack_ringbuffer_get_read_vector(const jack_ringbuffer_t *rb, jack_ringbuffer_data_t *vec) {
+	size_t r = rb->read_ptr;
+	size_t n = jack_ringbuffer_read_space(rb);
+	if (r + n > rb->size) {
+		vec[0].buf = rb->buf + r;
+		vec[0].len = rb->size - r;
+		vec[1].buf = rb->buf;
+		vec[1].len = (r + n) & rb->size_mask;
+	} else {
+		vec[0].buf = rb->buf + r;
+		vec[0].len = n;
+		vec[1].buf = NULL;
+		vec[1].len = 0;
+	}
+}
+
+void jack_ringbuffer_get_write_vector(const jack_ringbuffer_t *rb, jack_ringbuffer_data_t *vec) {
+	size_t w = rb->write_ptr;
+	size_t n = jack_ringbuffer_write_space(rb);
+	if (w + n > rb->size) {
+		vec[0].buf = rb->buf + w;
+		vec[0].len = rb->size - w;
+		vec[1].buf = rb->buf;
+		vec[1].len = (w + n) & rb->size_mask;
+	} else {
+		vec[0].buf = rb->buf + w;
+		vec[0].len = n;
+		vec[1].buf = NULL;
+		vec[1].len = 0;
+	}
+}
+
+void jack_ringbuffer_read_advance(jack_ringbuffer_t *rb, size_t cnt) {
+	__atomic_store_n(&rb->read_ptr, (rb->read_ptr + cnt) & rb->size_mask, __ATOMIC_RELEASE);
+}
+
+void jack_ringbuffer_write_advance(jack_ringbuffer_t *rb, size_t cnt) {
+	__atomic_store_n(&rb->write_ptr, (rb->write_ptr + cnt) & rb->size_mask, __ATOMIC_RELEASE);
+}
+
+size_t jack_ringbuffer_read(jack_ringbuffer_t *rb, char *dest, size_t cnt) {
+	jack_ringbuffer_data_t vec[2];
+	jack_ringbuffer_get_read_vector(rb, vec);
+	if (cnt > vec[0].len + vec[1].len)
+		cnt = vec[0].len + vec[1].len;
+	size_t n1 = cnt < vec[0].len ? cnt : vec[0].len;
+	memcpy(dest, vec[0].buf, n1);
+	if (cnt > n1)
+		memcpy(dest + n1, vec[1].buf, cnt - n1);
+	jack_ringbuffer_read_advance(rb, cnt);
+	return cnt;
+}
+
+size_t jack_ringbuffer_write(jack_ringbuffer_t *rb, const char *src, size_t cnt) {
+	jack_ringbuffer_data_t vec[2];
+	jack_ringbuffer_get_write_vector(rb, vec);
+	if (cnt > vec[0].len + vec[1].len)
+		cnt = vec[0].len + vec[1].len;
+	size_t n1 = cnt < vec[0].len ? cnt : vec[0].len;
+	memcpy(vec[0].buf, src, n1);
+	if (cnt > n1)
+		memcpy(vec[1].buf, src + n1, cnt - n1);
+	jack_ringbuffer_write_advance(rb, cnt);
+	return cnt;
+}
+
+//-----------------------------------------------------------------------------
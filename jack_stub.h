@@ -0,0 +1,56 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: JACK stand-in for offline tools
+ *
+ * Minimal in-process implementation of the JACK API used by
+ * ZynMidiRouter: ports with MIDI buffers, connections, ring-buffers
+ * and process-callback driving. No jackd needed.
+ *
+ * Copyright (C) 2015-2024 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+#include <jack/jack.h>
+#include <jack/midiport.h>
+
+//-----------------------------------------------------------------------------
+// JACK stand-in => link it instead of libjack
+//-----------------------------------------------------------------------------
+
+#define JACK_STUB_MAX_PORTS 128
+#define JACK_STUB_MAX_EVENTS 2048			// MIDI events per port buffer
+#define JACK_STUB_DATA_SIZE 65536			// MIDI data bytes per port buffer
+
+// Settings => call before jack_activate
+void jack_stub_set_buffer_size(jack_nframes_t nframes);
+void jack_stub_set_sample_rate(jack_nframes_t srate);
+
+// Set quantity of connections of a port, calling the port-connect callback
+void jack_stub_connect(jack_port_t *port, int connections);
+// Add event to an input port buffer, for the next cycle. Events must be sorted by time.
+int jack_stub_midi_in(jack_port_t *port, jack_nframes_t time, const uint8_t *data, size_t size);
+// Run the process callback for one period, then clear input buffers & advance frame time
+int jack_stub_cycle();
+
+// Frame time of the next cycle
+void jack_stub_set_frame_time(jack_nframes_t frame_time);
+jack_nframes_t jack_stub_get_frame_time();
+uint32_t jack_stub_get_lost_events(jack_port_t *port);
+
+//-----------------------------------------------------------------------------
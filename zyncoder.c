@@ -383,7 +383,7 @@ void send_zynswitch_midi(zynswitch_t *zsw) {
 		buffer[2] = 0;
 		zmip_send_midi_event(ZMIP_FAKE_INT, buffer, 3);
 		//Send MIDI event to UI
-		write_zynmidi((uint32_t)zsw->midi_event.type << 16);
+		write_zynmidi_internal((uint32_t)zsw->midi_event.type << 16, 1);
 		//fprintf(stderr, "ZynCore: Zynswitch MIDI SYSTEM RT event=> %d\n", zsw->midi_event.type);
 	}
 }
@@ -0,0 +1,142 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: zyncore-top
+ *
+ * Show live MIDI router statistics: event & drop rates per port.
+ * It reads the shared memory segment published by ZynMidiRouter,
+ * so it doesn't need to call into the library.
+ *
+ * Copyright (C) 2015-2024 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "zynmidirouter.h"
+
+//-----------------------------------------------------------------------------
+
+static const char * drop_names[ZYNMIDI_NUM_DROPS] = {
+	"filter", "unroute", "ring", "cc", "pc", "note", "range", "full"
+};
+
+struct zynmidi_stats_st stats_prev;
+struct zynmidi_stats_st stats_now;
+
+// Copy the shared statistics. Map them each time, so router restarts are handled.
+int read_stats(struct zynmidi_stats_st * stats) {
+	int fd = shm_open(ZYNMIDI_STATS_SHM_NAME, O_RDONLY, 0);
+	if (fd < 0)
+		return 0;
+	struct zynmidi_stats_st * shm = mmap(NULL, sizeof(struct zynmidi_stats_st), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (shm == MAP_FAILED)
+		return 0;
+	int res = 0;
+	if (__atomic_load_n(&shm->version, __ATOMIC_ACQUIRE) == ZYNMIDI_STATS_VERSION && shm->size == sizeof(struct zynmidi_stats_st)) {
+		memcpy(stats, shm, sizeof(struct zynmidi_stats_st));
+		res = 1;
+	}
+	munmap(shm, sizeof(struct zynmidi_stats_st));
+	return res;
+}
+
+void print_port(const char * dir, int i, struct zynmidi_port_stats_st * now, struct zynmidi_port_stats_st * prev, double secs, int show_all) {
+	uint32_t events = now->events - prev->events;
+	uint32_t drops[ZYNMIDI_NUM_DROPS];
+	uint32_t total_drops = 0;
+	for (int j = 0; j < ZYNMIDI_NUM_DROPS; j++) {
+		drops[j] = now->drops[j] - prev->drops[j];
+		total_drops += drops[j];
+	}
+	if (!show_all && events == 0 && total_drops == 0)
+		return;
+	printf("%-3s %2d %-12s %9.1f", dir, i, now->name, events / secs);
+	for (int j = 0; j < ZYNMIDI_NUM_DROPS; j++)
+		printf(" %7.1f", drops[j] / secs);
+	printf("\n");
+}
+
+void print_stats(double secs, int show_all) {
+	uint32_t cycles = stats_now.cycles - stats_prev.cycles;
+	printf("\033[H\033[2J");
+	printf("zyncore-top - %u Hz, %u frames, %.1f cycles/s, UI overflows: %.1f/s\n",
+		stats_now.sample_rate, stats_now.buffer_size, cycles / secs, (stats_now.ui_overflows - stats_prev.ui_overflows) / secs);
+	printf("SysEx: %u completed, %u aborted, %u oversize, %u no buffer\n\n",
+		stats_now.sysex.completed, stats_now.sysex.aborted, stats_now.sysex.oversize, stats_now.sysex.no_buffer);
+	printf("%-3s %2s %-12s %9s", "DIR", "#", "PORT", "events/s");
+	for (int j = 0; j < ZYNMIDI_NUM_DROPS; j++)
+		printf(" %7s", drop_names[j]);
+	printf("\n");
+	for (int i = 0; i < MAX_NUM_ZMIPS; i++) {
+		if (stats_now.zmips[i].name[0])
+			print_port("IN", i, stats_now.zmips + i, stats_prev.zmips + i, secs, show_all);
+	}
+	for (int i = 0; i < MAX_NUM_ZMOPS; i++) {
+		if (stats_now.zmops[i].name[0])
+			print_port("OUT", i, stats_now.zmops + i, stats_prev.zmops + i, secs, show_all);
+	}
+	fflush(stdout);
+}
+
+int main(int argc, char *argv[]) {
+	double secs = 1.0;
+	int show_all = 0;
+	int opt;
+	while ((opt = getopt(argc, argv, "i:ah")) != -1) {
+		switch (opt) {
+			case 'i':
+				secs = atof(optarg);
+				if (secs < 0.1)
+					secs = 0.1;
+				break;
+			case 'a':
+				show_all = 1;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-i seconds] [-a]\n", argv[0]);
+				fprintf(stderr, "  -i seconds: refresh interval (default 1.0)\n");
+				fprintf(stderr, "  -a: show idle ports too\n");
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	int have_prev = 0;
+	while (1) {
+		if (read_stats(&stats_now)) {
+			// Router restarted => counters are reset
+			if (have_prev && stats_now.cycles >= stats_prev.cycles)
+				print_stats(secs, show_all);
+			memcpy(&stats_prev, &stats_now, sizeof(struct zynmidi_stats_st));
+			have_prev = 1;
+		} else {
+			printf("\033[H\033[2JWaiting for ZynMidiRouter statistics (%s) ...\n", ZYNMIDI_STATS_SHM_NAME);
+			fflush(stdout);
+			have_prev = 0;
+		}
+		usleep((useconds_t)(secs * 1000000));
+	}
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,259 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Zyncore RT Log Library
+ *
+ * Realtime-safe logging for jack process callbacks
+ *
+ * Copyright (C) 2015-2024 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "zynlog.h"
+
+#if ZYNLOG_RING_SIZE & (ZYNLOG_RING_SIZE - 1)
+#error "ZYNLOG_RING_SIZE must be a power of 2"
+#endif
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+// Message formats, indexed by message ID. Formatted by the drain thread only.
+static const char * zynlog_formats[ZYNLOG_NUM_MSGS] = {
+	"ZynMidiRouter: Error writing jack midi output event! (output %d)",
+	"ZynMidiRouter: SysEx message has not end mark! (input %d, %d bytes)",
+	"ZynMidiRouter: Malformed SysEx message! (input %d, byte %d)",
+	"ZynMidiRouter: Bad ring-buffer record (%d bytes). Discarding ring content!",
+	"ZynMaster: Error getting jack input port buffer: %d frames",
+	"ZynMaster: Error getting jack output port buffer: %d frames",
+	"ZynMaster: Error writing jack midi output event!"
+};
+
+// Bounded multi-writer ring. Slot sequence is relative to the slot index, so the
+// zero-initialized ring is ready to use, even before the drain thread is started:
+//  seq == round => free for writing at position round + index
+//  seq == round + 1 => message ready for reading
+struct zynlog_slot_st zynlog_ring[ZYNLOG_RING_SIZE];
+uint32_t zynlog_head;								// Next write position (RT writers)
+uint32_t zynlog_tail;								// Next read position (drain, with zynlog_drain_mutex)
+
+uint32_t zynlog_queued[ZYNLOG_NUM_MSGS];			// Messages in ring, by ID
+uint32_t zynlog_suppressed[ZYNLOG_NUM_MSGS];		// Messages not queued because of ZYNLOG_MAX_QUEUED_PER_MSG, by ID
+uint32_t zynlog_dropped;							// Messages not queued because ring was full
+
+// Drain state => only used with zynlog_drain_mutex
+pthread_mutex_t zynlog_drain_mutex = PTHREAD_MUTEX_INITIALIZER;
+uint64_t zynlog_last_print_us[ZYNLOG_NUM_MSGS];		// Last time a message with this ID was printed
+uint32_t zynlog_repeated[ZYNLOG_NUM_MSGS];			// Messages with this ID not printed since then
+int32_t zynlog_last_args[ZYNLOG_NUM_MSGS][2];		// Arguments of last message with this ID
+uint32_t zynlog_suppressed_printed[ZYNLOG_NUM_MSGS];
+uint32_t zynlog_dropped_printed;
+
+// Drain thread
+pthread_mutex_t zynlog_init_mutex = PTHREAD_MUTEX_INITIALIZER;
+int zynlog_refcount = 0;
+int zynlog_running = 0;
+pthread_t zynlog_thread_tid;
+
+//-----------------------------------------------------------------------------
+// RT side
+//-----------------------------------------------------------------------------
+
+int zynlog(zynlog_msg_id id, int32_t arg0, int32_t arg1) {
+	if ((unsigned)id >= ZYNLOG_NUM_MSGS)
+		return 0;
+
+	// Rate-limit repeated messages => don't fill the ring with the same message
+	if (__atomic_fetch_add(&zynlog_queued[id], 1, __ATOMIC_RELAXED) >= ZYNLOG_MAX_QUEUED_PER_MSG) {
+		__atomic_fetch_sub(&zynlog_queued[id], 1, __ATOMIC_RELAXED);
+		__atomic_fetch_add(&zynlog_suppressed[id], 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+
+	// Claim a slot
+	struct zynlog_slot_st * slot;
+	uint32_t pos = __atomic_load_n(&zynlog_head, __ATOMIC_RELAXED);
+	uint32_t round;
+	while (1) {
+		slot = zynlog_ring + (pos & (ZYNLOG_RING_SIZE - 1));
+		round = pos & ~(ZYNLOG_RING_SIZE - 1);
+		int32_t dif = (int32_t)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - round);
+		if (dif == 0) {
+			if (__atomic_compare_exchange_n(&zynlog_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+				break;
+		} else if (dif < 0) {
+			// Ring is full => slot was not read yet
+			__atomic_fetch_sub(&zynlog_queued[id], 1, __ATOMIC_RELAXED);
+			__atomic_fetch_add(&zynlog_dropped, 1, __ATOMIC_RELAXED);
+			return 0;
+		} else {
+			// Other writer took the slot
+			pos = __atomic_load_n(&zynlog_head, __ATOMIC_RELAXED);
+		}
+	}
+
+	slot->id = id;
+	slot->args[0] = arg0;
+	slot->args[1] = arg1;
+	__atomic_store_n(&slot->seq, round + 1, __ATOMIC_RELEASE);
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Drain side
+//-----------------------------------------------------------------------------
+
+static uint64_t zynlog_now_us() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void zynlog_print(zynlog_msg_id id, int32_t arg0, int32_t arg1, uint32_t repeated) {
+	fprintf(stderr, zynlog_formats[id], arg0, arg1);
+	if (repeated > 0)
+		fprintf(stderr, " (+%u similar messages)", repeated);
+	fprintf(stderr, "\n");
+}
+
+void zynlog_flush() {
+	pthread_mutex_lock(&zynlog_drain_mutex);
+	uint64_t now = zynlog_now_us();
+
+	while (1) {
+		struct zynlog_slot_st * slot = zynlog_ring + (zynlog_tail & (ZYNLOG_RING_SIZE - 1));
+		uint32_t round = zynlog_tail & ~(ZYNLOG_RING_SIZE - 1);
+		if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != round + 1)
+			break;
+		zynlog_msg_id id = slot->id;
+		int32_t arg0 = slot->args[0];
+		int32_t arg1 = slot->args[1];
+		// Release the slot for next round
+		__atomic_store_n(&slot->seq, round + ZYNLOG_RING_SIZE, __ATOMIC_RELEASE);
+		zynlog_tail++;
+		if (id >= ZYNLOG_NUM_MSGS)
+			continue;
+		__atomic_fetch_sub(&zynlog_queued[id], 1, __ATOMIC_RELAXED);
+
+		zynlog_last_args[id][0] = arg0;
+		zynlog_last_args[id][1] = arg1;
+		if (now - zynlog_last_print_us[id] >= ZYNLOG_RATE_LIMIT_US) {
+			zynlog_print(id, arg0, arg1, zynlog_repeated[id]);
+			zynlog_last_print_us[id] = now;
+			zynlog_repeated[id] = 0;
+		} else {
+			zynlog_repeated[id]++;
+		}
+	}
+
+	// Count messages suppressed by RT writers as repeated
+	for (int id = 0; id < ZYNLOG_NUM_MSGS; id++) {
+		uint32_t suppressed = __atomic_load_n(&zynlog_suppressed[id], __ATOMIC_RELAXED);
+		zynlog_repeated[id] += suppressed - zynlog_suppressed_printed[id];
+		zynlog_suppressed_printed[id] = suppressed;
+		// Report held-back repetitions once the rate-limit interval is over
+		if (zynlog_repeated[id] > 0 && now - zynlog_last_print_us[id] >= ZYNLOG_RATE_LIMIT_US) {
+			zynlog_print(id, zynlog_last_args[id][0], zynlog_last_args[id][1], zynlog_repeated[id] - 1);
+			zynlog_last_print_us[id] = now;
+			zynlog_repeated[id] = 0;
+		}
+	}
+
+	uint32_t dropped = __atomic_load_n(&zynlog_dropped, __ATOMIC_RELAXED);
+	if (dropped != zynlog_dropped_printed) {
+		fprintf(stderr, "ZynLog: Log ring is full. %u messages dropped!\n", dropped - zynlog_dropped_printed);
+		zynlog_dropped_printed = dropped;
+	}
+	pthread_mutex_unlock(&zynlog_drain_mutex);
+}
+
+void * zynlog_thread(void *arg) {
+	while (__atomic_load_n(&zynlog_running, __ATOMIC_ACQUIRE)) {
+		zynlog_flush();
+		usleep(ZYNLOG_POLL_US);
+	}
+	return NULL;
+}
+
+//-----------------------------------------------------------------------------
+// Library Initialization
+//-----------------------------------------------------------------------------
+
+int init_zynlog() {
+	pthread_mutex_lock(&zynlog_init_mutex);
+	if (zynlog_refcount++ > 0) {
+		pthread_mutex_unlock(&zynlog_init_mutex);
+		return 1;
+	}
+	// Low priority thread => don't inherit RT scheduling from caller
+	pthread_attr_t attr;
+	struct sched_param param;
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	param.sched_priority = 0;
+	pthread_attr_setschedparam(&attr, &param);
+	__atomic_store_n(&zynlog_running, 1, __ATOMIC_RELEASE);
+	int err = pthread_create(&zynlog_thread_tid, &attr, &zynlog_thread, NULL);
+	pthread_attr_destroy(&attr);
+	if (err != 0) {
+		fprintf(stderr, "ZynLog: Can't create log thread :[%s]\n", strerror(err));
+		zynlog_running = 0;
+		zynlog_refcount--;
+		pthread_mutex_unlock(&zynlog_init_mutex);
+		return 0;
+	}
+	pthread_mutex_unlock(&zynlog_init_mutex);
+	return 1;
+}
+
+int end_zynlog() {
+	pthread_mutex_lock(&zynlog_init_mutex);
+	if (zynlog_refcount == 0 || --zynlog_refcount > 0) {
+		pthread_mutex_unlock(&zynlog_init_mutex);
+		return 1;
+	}
+	__atomic_store_n(&zynlog_running, 0, __ATOMIC_RELEASE);
+	pthread_join(zynlog_thread_tid, NULL);
+	pthread_mutex_unlock(&zynlog_init_mutex);
+	zynlog_flush();
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Statistics
+//-----------------------------------------------------------------------------
+
+uint32_t zynlog_get_num_suppressed(zynlog_msg_id id) {
+	if ((unsigned)id >= ZYNLOG_NUM_MSGS)
+		return 0;
+	return __atomic_load_n(&zynlog_suppressed[id], __ATOMIC_RELAXED);
+}
+
+uint32_t zynlog_get_num_dropped() {
+	return __atomic_load_n(&zynlog_dropped, __ATOMIC_RELAXED);
+}
+
+//-----------------------------------------------------------------------------
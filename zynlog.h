@@ -0,0 +1,72 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: Zyncore RT Log Library
+ *
+ * Realtime-safe logging for jack process callbacks
+ *
+ * Copyright (C) 2015-2024 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdint.h>
+
+//-----------------------------------------------------------------------------
+// RT Log => jack process callbacks must not do blocking I/O.
+// RT code posts a message ID & 2 integer arguments into a lock-free ring.
+// A low-priority thread formats and writes them to stderr, rate-limited.
+//-----------------------------------------------------------------------------
+
+#define ZYNLOG_RING_SIZE 256				// Queued messages. Must be a power of 2!
+#define ZYNLOG_MAX_QUEUED_PER_MSG 4			// Further messages with same ID are only counted while these are pending
+#define ZYNLOG_POLL_US 100000				// Drain thread period
+#define ZYNLOG_RATE_LIMIT_US 1000000		// Minimum interval between printed messages with same ID
+
+typedef enum {
+	ZYNLOG_MIDI_OUT_WRITE_ERROR = 0,		// Error writing jack midi output event (arg0 = zmop)
+	ZYNLOG_SYSEX_NO_END_MARK,				// SysEx message has not end mark (arg0 = zmip, arg1 = size)
+	ZYNLOG_SYSEX_MALFORMED,					// Malformed SysEx message (arg0 = zmip, arg1 = byte position)
+	ZYNLOG_RB_BAD_RECORD,					// Bad ring-buffer record, discarded (arg0 = record size)
+	ZYNLOG_MASTER_IN_BUFFER_ERROR,			// ZynMaster: Error getting input buffer (arg0 = nframes)
+	ZYNLOG_MASTER_OUT_BUFFER_ERROR,			// ZynMaster: Error getting output buffer (arg0 = nframes)
+	ZYNLOG_MASTER_OUT_WRITE_ERROR,			// ZynMaster: Error writing output event
+	ZYNLOG_NUM_MSGS
+} zynlog_msg_id;
+
+struct zynlog_slot_st {
+	uint32_t seq;							// Slot sequence => free for writing when it equals ring position
+	uint16_t id;
+	int32_t args[2];
+};
+
+extern struct zynlog_slot_st zynlog_ring[ZYNLOG_RING_SIZE];	// Registered as RT memory by clients
+
+// Start/stop the drain thread. Reference counted, so every RT client can init/end it.
+int init_zynlog();
+int end_zynlog();
+
+// Post a message. Realtime-safe & lock-free (multiple writers). Returns 0 if message was dropped.
+int zynlog(zynlog_msg_id id, int32_t arg0, int32_t arg1);
+
+// Write pending messages now. Not realtime-safe!
+void zynlog_flush();
+
+// Statistics
+uint32_t zynlog_get_num_suppressed(zynlog_msg_id id);
+uint32_t zynlog_get_num_dropped();
+
+//-----------------------------------------------------------------------------
@@ -28,6 +28,8 @@
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
+#include "zynlog.h"
+
 #ifdef ZYNAPTIK_CONFIG
 	#include "zynaptik.h"
 #endif
@@ -60,10 +62,13 @@ int init_zynmaster_jack() {
 		return 0;
 	}
 
-	//Init Jack Process
+	//Init Jack Process => it logs through zynlog
+	if (!init_zynlog())
+		return 0;
 	jack_set_process_callback(zynmaster_jack_client, zynmaster_jack_process, 0);
 	if (jack_activate(zynmaster_jack_client)) {
 		fprintf(stderr, "ZynMaster: Error activating jack client.\n");
+		end_zynlog();
 		return 0;
 	}
 
@@ -75,6 +80,7 @@ int end_zynmaster_jack() {
 		fprintf(stderr, "ZynMaster: Error closing jack client.\n");
 		return 0;
 	}
+	end_zynlog();
 	return 1;
 }
 
@@ -82,14 +88,14 @@ int zynmaster_jack_process(jack_nframes_t nframes, void *arg) {
 	//Read jackd data buffer
 	void *input_port_buffer = jack_port_get_buffer(zynmaster_jack_port_midi_in, nframes);
 	if (input_port_buffer==NULL) {
-		fprintf(stderr, "ZynMaster: Error getting jack input port buffer: %d frames\n", nframes);
+		zynlog(ZYNLOG_MASTER_IN_BUFFER_ERROR, nframes, 0);
 		return -1;
 	}
 
 	//Get jack output data buffer and clear it
 	void *output_port_buffer = jack_port_get_buffer(zynmaster_jack_port_midi_out, nframes);
 	if (output_port_buffer==NULL) {
-		fprintf(stderr, "ZynMaster: Error getting jack output port buffer: %d frames\n", nframes);
+		zynlog(ZYNLOG_MASTER_OUT_BUFFER_ERROR, nframes, 0);
 		return -1;
 	}
 	jack_midi_clear_buffer(output_port_buffer);
@@ -104,7 +110,7 @@ int zynmaster_jack_process(jack_nframes_t nframes, void *arg) {
 		#endif
 		
 		if (jack_midi_event_write(output_port_buffer, ev.time, ev.buffer, ev.size)!=0) {
-			fprintf(stderr, "ZynMaster: Error writing jack midi output event!\n");
+			zynlog(ZYNLOG_MASTER_OUT_WRITE_ERROR, 0, 0);
 		}
 	}
 
@@ -28,10 +28,16 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
 #include <jack/jack.h>
 #include <jack/midiport.h>
 
 #include "zynpot.h"
+#include "zynlog.h"
 #include "zynmidirouter.h"
 
 //-----------------------------------------------------------------------------
@@ -46,15 +52,97 @@ int midi_system_events;					// Flag to enable/disable system events globally
 int midi_learning_mode;					// To flag "MIDI learning" from UI => Is it needed?
 int8_t global_transpose;     			// All incoming (zmip) notes are transposed
 jack_nframes_t last_frame;				// Index of last frame in each jack cycle
+jack_nframes_t rb_frame_origin;			// Frame time scheduled at frame 0 of current cycle => ring-buffer events are delayed one period
 
-midi_filter_t midi_filter;
+struct midi_filter_map_st midi_filters[MAX_NUM_MIDI_FILTERS];	// MIDI_FILTER_GLOBAL + filters owned by zmips
 struct zmip_st zmips[MAX_NUM_ZMIPS];
 struct zmop_st zmops[MAX_NUM_ZMOPS];
 
-uint8_t event_buffer[JACK_MIDI_BUFFER_SIZE];		// Buffer for processing internal/direct MIDI events
+uint8_t rb_wrap_buffer[JACK_MIDI_BUFFER_SIZE];		// Direct output ring-buffer records wrapped around the ring end are copied here
 
 jack_client_t * jack_client;
 jack_ringbuffer_t * zynmidi_buffer;
+jack_ringbuffer_t * zynmidi_record_buffer;
+jack_ringbuffer_t * zynmidi_internal_buffer;	// Internal events => UI, forwarded by jack process (single producer for UI rings)
+pthread_mutex_t zynmidi_internal_mutex = PTHREAD_MUTEX_INITIALIZER;	// Serialize writers of internal events
+int zynmidi_mode;						// UI channels used for captured events (ZYNMIDI_MODE_*)
+
+// Router configuration snapshots => See "Router configuration management" below
+struct router_config_st router_config_slots[NUM_ROUTER_CONFIG_SLOTS];
+struct router_config_st * router_config;			// Snapshot used by jack process. Only jack process changes it.
+struct router_config_st * router_config_pending;	// Last published snapshot, not claimed by jack process yet
+struct router_config_st * router_config_published;	// Last published snapshot: pending or claimed by jack process (writers only)
+struct router_config_st * router_config_claimed;	// Last snapshot known to be claimed by jack process (writers only)
+pthread_mutex_t router_config_mutex;				// Serialize writers
+int router_config_depth;							// Nesting level of router_config_begin/commit calls
+
+// SysEx reassembly pool => See "SysEx reassembly" below
+struct sysex_buffer_st * sysex_pool;
+struct sysex_buffer_st * sysex_pool_free[SYSEX_POOL_SIZE];	// Stack of free buffers. Only jack process uses it after init.
+int sysex_pool_nfree;
+
+// Router statistics => See "Router Statistics" below
+struct zynmidi_stats_st router_stats_private;		// Used if shared memory is not available
+struct zynmidi_stats_st * router_stats = &router_stats_private;
+int router_stats_locked;						// Statistics memory is locked (shared memory only)
+const char * router_stats_shm_name = ZYNMIDI_STATS_SHM_NAME;
+
+// Jack process profiling => See "Jack Process Profiling" below
+int router_profiling;								// Enable profiling
+int router_profile_reset;							// Reset request, applied by jack process
+struct zynmidi_profile_st router_profile;
+uint64_t router_profile_last_start;					// Start time of last profiled cycle (jack process only)
+
+// RT memory mode => See "RT Memory" below
+int router_rt_memory;								// ZYNMIDI_RT_MEMORY_*
+int router_rt_memory_ready;							// Static regions registered by init_router_rt_memory
+int router_rt_memory_all;							// Process is locked with mlockall
+int router_rt_memory_all_owned;						// Nothing else was locked before mlockall => munlockall allowed
+struct zynmidi_rt_region_st router_rt_regions[ZYNMIDI_RT_MEMORY_MAX_REGIONS];
+int router_rt_n_regions;
+pthread_mutex_t router_rt_memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// MIDI trace capture => See "MIDI Trace Capture" below
+int router_trace_active;							// Capture enabled
+jack_ringbuffer_t * router_trace_rb;				// Records from jack process, drained to file by trace thread
+FILE * router_trace_file;
+pthread_mutex_t router_trace_mutex = PTHREAD_MUTEX_INITIALIZER;	// Serialize file writes
+uint32_t router_trace_cfg_seq;						// Last CONFIG record seq (writers, with router_config_mutex)
+int router_trace_need_filter;						// Next CONFIG record must include the MIDI filter
+uint32_t router_trace_rt_seq;						// Config seq applied by jack process, 0 if not recording (jack process only)
+uint32_t router_trace_lost;							// Records lost because ring-buffer was full
+uint32_t router_trace_lost_written;					// Lost records already reported in file (trace thread)
+int router_trace_running;
+pthread_t router_trace_tid;
+
+// All-notes-off requests => bitmask of zmops, processed by jack process at the start of next cycle
+#if MAX_NUM_ZMOPS > 64
+#error "all_notes_off_request can't hold MAX_NUM_ZMOPS bits"
+#endif
+uint64_t all_notes_off_request;
+
+// Zmops with acquired & cleared buffer => only jack process uses it
+int n_live_zmops;
+uint8_t live_zmops[MAX_NUM_ZMOPS];
+
+// Note ownership => bitmask of zmops that received each note-on from ACTI zmips, by input channel & note.
+// Note-off events are routed to the owners, so they don't depend on the active chain. Only jack process uses it.
+// Tables (16KB) are allocated only for zmips having the ACTI flag => See zmip_st.note_owners
+#if MAX_NUM_ZMOPS > 64
+#error "note owners can't hold MAX_NUM_ZMOPS bits"
+#endif
+
+// ACTI zmips turned inactive (removed or disconnected) => bitmask of zmips whose owned notes must be released
+#if MAX_NUM_ZMIPS > 64
+#error "zmips_notes_release can't hold MAX_NUM_ZMIPS bits"
+#endif
+uint64_t zmips_notes_release;							// Only jack process uses it
+
+// Direct input lanes => See "MIDI Input Ports management" below
+static __thread uint8_t zmip_lane_leased[MAX_NUM_ZMIPS];	// Lane leased by this thread for each zmip, 0 if none
+pthread_key_t zmip_lane_key;								// Release leased lanes when the thread exits
+pthread_mutex_t zmip_shared_lane_mutex;						// Serialize writers of the shared lane (0)
+pthread_mutex_t zmop_send_mutex;							// Serialize writers of zmop direct-out ring-buffers & their removal
 
 //-----------------------------------------------------------------------------
 // Library Initialization
@@ -69,50 +157,361 @@ int init_zynmidirouter() {
 	midi_system_events = 1;
 	midi_learning_mode = 0;
 	global_transpose = 0;
+	zynmidi_mode = ZYNMIDI_MODE_WORDS;
 
-	if (!init_zynmidi_buffer())
+	// Jack process never writes to stderr => it logs through zynlog
+	if (!init_zynlog())
 		return 0;
+	init_router_stats();
+	init_router_profile();
+	if (!init_zynmidi_buffer()) {
+		end_zynlog();
+		return 0;
+	}
+	if (!init_sysex_pool()) {
+		end_zynmidi_buffer();
+		end_zynlog();
+		return 0;
+	}
 	if (!init_midi_router()) {
+		end_sysex_pool();
 		end_zynmidi_buffer();
+		end_zynlog();
 		return 0;
 	}
+	init_router_rt_memory();
 	if (!init_jack_midi("ZynMidiRouter")) {
+		end_router_rt_memory();
 		end_midi_router();
+		end_sysex_pool();
 		end_zynmidi_buffer();
+		end_zynlog();
 		return 0;
 	}
+	if (router_rt_memory)
+		router_rt_memory_report();
 	return 1;
 }
 
 int end_zynmidirouter() {
+	stop_router_trace();
+	end_router_rt_memory();
 	if (!end_jack_midi())
 		return 0;
 	if (!end_midi_router())
 		return 0;
+	if (!end_sysex_pool())
+		return 0;
 	if (!end_zynmidi_buffer())
 		return 0;
+	end_router_stats();
+	end_zynlog();
 	return 1;
 }
 
 int init_midi_router() {
-	int i, j, k;
-
-	for (i = 0; i < 8; i++) {
-		for (j = 0; j < 16; j++) {
-			for (k = 0; k < 128; k++) {
-				midi_filter.event_map[i][j][k].type = THRU_EVENT;
-				midi_filter.event_map[i][j][k].chan = j;
-				midi_filter.event_map[i][j][k].num = k;
-			}
-		}
+	pthread_mutexattr_t attr;
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	if (pthread_mutex_init(&router_config_mutex, &attr)) {
+		fprintf(stderr, "ZynMidiRouter: Error initializing router config mutex.\n");
+		return 0;
+	}
+	pthread_mutexattr_destroy(&attr);
+	router_config = NULL;
+	router_config_pending = NULL;
+	router_config_published = NULL;
+	router_config_claimed = NULL;
+	router_config_depth = 0;
+
+	if (pthread_mutex_init(&zmip_shared_lane_mutex, NULL) || pthread_key_create(&zmip_lane_key, zmip_release_lanes)) {
+		fprintf(stderr, "ZynMidiRouter: Error initializing direct input lanes.\n");
+		return 0;
 	}
+	if (pthread_mutex_init(&zmop_send_mutex, NULL)) {
+		fprintf(stderr, "ZynMidiRouter: Error initializing direct output mutex.\n");
+		return 0;
+	}
+	zmips_notes_release = 0;
+
+	// Reset MIDI filter and publish initial snapshot
+	reset_midi_filter_event_map();
 	return 1;
 }
 
 int end_midi_router() {
+	pthread_key_delete(zmip_lane_key);
+	pthread_mutex_destroy(&zmip_shared_lane_mutex);
+	pthread_mutex_destroy(&zmop_send_mutex);
+	pthread_mutex_destroy(&router_config_mutex);
 	return 1;
 }
 
+//-----------------------------------------------------------------------------
+// Router configuration management
+//-----------------------------------------------------------------------------
+// Setters edit the writer side: global settings, MIDI filter and zmip/zmop structs.
+// Jack process never reads the writer side. It reads an immutable snapshot, compiled
+// from the writer side when the (outermost) change is committed and claimed by jack
+// process at the start of the next cycle. 3 slots are enough: the one used by jack
+// process, a pending one not claimed yet and a free one to compile the next.
+// Jack process claims the pending snapshot by exchanging it with NULL, so writers know
+// which snapshots it could be using without reading its active pointer: the last one
+// published (pending or just claimed) and the last one known to be claimed.
+
+void router_config_begin() {
+	pthread_mutex_lock(&router_config_mutex);
+	router_config_depth++;
+}
+
+void router_config_commit() {
+	if (--router_config_depth == 0)
+		publish_router_config();
+	pthread_mutex_unlock(&router_config_mutex);
+}
+
+// Check if any zmip in snapshot uses a compiled MIDI filter
+static int midi_filter_rules_used(struct router_config_st * cfg, midi_filter_rules_t * rules) {
+	if (!cfg)
+		return 0;
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		if (cfg->zmips[izmip].midi_filter == rules)
+			return 1;
+	}
+	return 0;
+}
+
+// Compile the status-byte tables of a zmop. Snapshot's global settings & zmop configs must be set.
+static void zmop_compile_status(struct router_config_st * cfg, int izmop) {
+	struct zmop_config_st * zmop_cfg = cfg->zmops + izmop;
+	// ACTI => is this the active zmop? (active MIDI channel or active chain)
+	int active = (cfg->active_midi_chan && cfg->active_chain >= 0 && cfg->zmops[cfg->active_chain].midi_chan == zmop_cfg->midi_chan) ||
+		izmop == cfg->active_chain;
+	int chantrans = (zmop_cfg->flags & FLAG_ZMOP_CHAN_TRANSFILTER) && zmop_cfg->midi_chan >= 0;
+
+	for (int acti = 0; acti < 2; acti++) {
+		for (int b0 = 0; b0 < 256; b0++) {
+			struct zmop_status_st * st = &cfg->zmop_status[izmop][acti][b0];
+			st->status = b0;
+			st->op = 0;
+			// System messages
+			if (b0 >= SYSTEM_EXCLUSIVE) {
+				if (b0 == SYSTEM_EXCLUSIVE && (zmop_cfg->flags & FLAG_ZMOP_DROPSYSEX))
+					st->op = ZMOP_STATUS_DROP;
+				else if (b0 > SYSTEM_EXCLUSIVE && (zmop_cfg->flags & FLAG_ZMOP_DROPSYS))
+					st->op = ZMOP_STATUS_DROPSYS;
+				continue;
+			}
+			// Channel messages ...
+			uint8_t event_type = b0 >> 4;
+			uint8_t event_chan = b0 & 0x0F;
+			if (chantrans && acti) {
+				// ACTI => route events to active chain, translating channel as required.
+				// Discard message if output midi channel is not mapped.
+				if (zmop_cfg->midi_chans[zmop_cfg->midi_chan] < 0) {
+					st->op = ZMOP_STATUS_DROP;
+					continue;
+				}
+				st->op = ZMOP_STATUS_ACTI | (active ? 0 : ZMOP_STATUS_INACTIVE);
+				st->status = (b0 & 0xF0) | (zmop_cfg->midi_chan & 0x0F);
+			} else if (zmop_cfg->midi_chans[event_chan] == -1) {
+				// MULTI or no channel translation => discard messages in disabled channels
+				st->op = ZMOP_STATUS_DROP;
+				continue;
+			}
+			if (event_type == CTRL_CHANGE && (zmop_cfg->flags & FLAG_ZMOP_DROPCC))
+				st->op |= ZMOP_STATUS_DROPCC;
+			else if (event_type == PROG_CHANGE && (zmop_cfg->flags & FLAG_ZMOP_DROPPC))
+				st->op |= ZMOP_STATUS_DROPPC;
+			else if (event_type == NOTE_ON || event_type == NOTE_OFF)
+				st->op |= ZMOP_STATUS_NOTE | ((zmop_cfg->flags & FLAG_ZMOP_DROPNOTE) ? ZMOP_STATUS_DROPNOTE : 0);
+		}
+	}
+}
+
+// Compile writer side into a free snapshot and publish it. Called with router_config_mutex held.
+void publish_router_config() {
+	// Snapshots that jack process could be using, now or in the next cycle => don't touch them
+	struct router_config_st * published = router_config_published;
+	struct router_config_st * claimed = router_config_claimed;
+
+	struct router_config_st * cfg = NULL;
+	for (int i = 0; i < NUM_ROUTER_CONFIG_SLOTS; i++) {
+		cfg = router_config_slots + i;
+		if (cfg != published && cfg != claimed)
+			break;
+	}
+
+	// MIDI filters are big => compile only the changed ones, into a slot not used by those snapshots
+	uint32_t filters_changed = 0;
+	for (int ifilter = 0; ifilter < MAX_NUM_MIDI_FILTERS; ifilter++) {
+		struct midi_filter_map_st * mf = midi_filters + ifilter;
+		if (ifilter != MIDI_FILTER_GLOBAL && mf->refs == 0)
+			continue;
+		if (!mf->dirty && mf->rules && published)
+			continue;
+		for (int i = 0; i < NUM_ROUTER_CONFIG_SLOTS; i++) {
+			mf->rules = mf->rules_slots + i;
+			if (!midi_filter_rules_used(published, mf->rules) && !midi_filter_rules_used(claimed, mf->rules))
+				break;
+		}
+		midi_filter_compile(&mf->filter, mf->rules);
+		mf->dirty = 0;
+		filters_changed |= 1 << ifilter;
+	}
+
+	// Global settings
+	cfg->active_chain = active_chain;
+	cfg->active_midi_chan = active_midi_chan;
+	cfg->tuning_pitchbend = tuning_pitchbend;
+	cfg->midi_master_chan = midi_master_chan;
+	cfg->midi_system_events = midi_system_events;
+	cfg->midi_learning_mode = midi_learning_mode;
+	cfg->zynmidi_mode = zynmidi_mode;
+	cfg->global_transpose = global_transpose;
+
+	// Output ports
+	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+		struct zmop_st * zmop = zmops + izmop;
+		struct zmop_config_st * zmop_cfg = cfg->zmops + izmop;
+		zmop_cfg->flags = zmop->flags;
+		zmop_cfg->output = zmop_select_output_handler(zmop->flags, tuning_pitchbend);
+		zmop_cfg->midi_chan = zmop->midi_chan;
+		for (int i = 0; i < 16; i++)
+			zmop_cfg->midi_chans[i] = zmop->midi_chans[i];
+		memcpy(cfg->zmop_cc_route[izmop], zmop->cc_route, sizeof(zmop->cc_route));
+		zmop_cfg->note_low = zmop->note_low;
+		zmop_cfg->note_high = zmop->note_high;
+		zmop_cfg->transpose_octave = zmop->transpose_octave;
+		zmop_cfg->transpose_semitone = zmop->transpose_semitone;
+		zmop_cfg->n_connections = zmop->n_connections;
+	}
+
+	// Status-byte tables => only connected zmops can be in a fan-out
+	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+		if (zmops[izmop].n_connections > 0)
+			zmop_compile_status(cfg, izmop);
+	}
+
+	// Active ports => jack process doesn't touch the rest, so unused slots cost nothing
+	cfg->n_active_zmips = 0;
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		if (!zmips[izmip].registered)
+			continue;
+		if ((zmips[izmip].jport && zmips[izmip].n_connections > 0) || (zmips[izmip].flags & FLAG_ZMIP_DIRECTIN))
+			cfg->active_zmips[cfg->n_active_zmips++] = izmip;
+	}
+	cfg->n_active_zmops = 0;
+	cfg->n_directout_zmops = 0;
+	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+		if (!zmops[izmop].registered)
+			continue;
+		if (zmops[izmop].n_connections > 0)
+			cfg->active_zmops[cfg->n_active_zmops++] = izmop;
+		if ((zmops[izmop].flags & FLAG_ZMOP_DIRECTOUT) && zmops[izmop].rbuffer)
+			cfg->directout_zmops[cfg->n_directout_zmops++] = izmop;
+	}
+
+	// Input ports & routing fan-out: routed and connected zmops, in ascending order
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		struct zmip_config_st * zmip_cfg = cfg->zmips + izmip;
+		zmip_cfg->flags = zmips[izmip].flags;
+		zmip_cfg->external = zmip_is_dev(izmip) || izmip == ZMIP_SEQ || izmip == ZMIP_STEP || izmip == ZMIP_CTRL;
+		zmip_cfg->midi_filter = midi_filters[zmips[izmip].midi_filter].rules;
+		zmip_cfg->n_fanout = 0;
+		for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+			// Don't waste CPU cycles with unconnected output ports. Nobody is listening there!!
+			if (zmops[izmop].n_connections > 0 && zmops[izmop].route_from_zmips[izmip])
+				zmip_cfg->fanout[zmip_cfg->n_fanout++] = izmop;
+		}
+	}
+
+	// Passthrough routes => a jack input without processing, routed only to a connected output
+	// without processing, that doesn't receive from other active inputs. Its events are copied
+	// straight to the output, out of the merge. Direct-out events are flushed after them, as usual.
+	int n_sources[MAX_NUM_ZMOPS] = { 0 };
+	for (int k = 0; k < cfg->n_active_zmips; k++) {
+		struct zmip_config_st * zmip_cfg = cfg->zmips + cfg->active_zmips[k];
+		for (int j = 0; j < zmip_cfg->n_fanout; j++)
+			n_sources[zmip_cfg->fanout[j]]++;
+	}
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		struct zmip_config_st * zmip_cfg = cfg->zmips + izmip;
+		zmip_cfg->passthrough = -1;
+		if (!zmips[izmip].jport || (zmip_cfg->flags & (FLAG_ZMIP_UI | FLAG_ZMIP_FILTER | FLAG_ZMIP_CC_AUTO_MODE | FLAG_ZMIP_ACTIVE_CHAIN | FLAG_ZMIP_DIRECTIN)))
+			continue;
+		if (zmip_cfg->n_fanout != 1 || !cfg->midi_system_events)
+			continue;
+		int izmop = zmip_cfg->fanout[0];
+		struct zmop_config_st * zmop_cfg = cfg->zmops + izmop;
+		if (n_sources[izmop] != 1 || zmop_cfg->output != zmop_output_plain || (zmop_cfg->flags & (FLAG_ZMOP_DROPPC | FLAG_ZMOP_DROPCC |
+			FLAG_ZMOP_DROPSYS | FLAG_ZMOP_DROPSYSEX | FLAG_ZMOP_DROPNOTE | FLAG_ZMOP_CHAN_TRANSFILTER)))
+			continue;
+		int i = 0;
+		while (i < 16 && zmop_cfg->midi_chans[i] >= 0)
+			i++;
+		if (i == 16)
+			zmip_cfg->passthrough = izmop;
+	}
+
+	// Record configuration into MIDI trace, so jack process can tag the cycle where it's applied
+	cfg->trace_seq = 0;
+	if (__atomic_load_n(&router_trace_active, __ATOMIC_ACQUIRE))
+		cfg->trace_seq = router_trace_write_config(filters_changed);
+
+	// Replace pending snapshot. If there was none, jack process claimed the last published one.
+	if (!__atomic_exchange_n(&router_config_pending, cfg, __ATOMIC_ACQ_REL) && published)
+		router_config_claimed = published;
+	router_config_published = cfg;
+}
+
+// Wait until jack process claimed the last published snapshot and finished the cycle where it
+// did it, so resources dropped from the configuration can be released. If jack process is not
+// running, it gives up after 1 second and returns 0, as nobody is using them.
+int router_config_sync() {
+	int i = 0;
+	for (; i < 1000 && __atomic_load_n(&router_config_pending, __ATOMIC_ACQUIRE); i++)
+		usleep(1000);
+	// The cycle claiming the snapshot could be running yet => wait until the next one starts
+	uint32_t cycles = __atomic_load_n(&router_stats->cycles, __ATOMIC_ACQUIRE);
+	for (; i < 1000; i++) {
+		if (__atomic_load_n(&router_stats->cycles, __ATOMIC_ACQUIRE) - cycles >= 2)
+			return 1;
+		usleep(1000);
+	}
+	return 0;
+}
+
+// Release runtime state of zmips that are not active anymore, as jack process won't feed them:
+// SysEx reassembly buffers go back to the pool & held notes of ACTI zmips are scheduled for release.
+// Called from jack process on config change.
+static void zmips_release_inactive(struct router_config_st * old, struct router_config_st * cfg) {
+	uint8_t active[MAX_NUM_ZMIPS] = {0};
+	for (int k = 0; k < cfg->n_active_zmips; k++)
+		active[cfg->active_zmips[k]] = 1;
+	for (int k = 0; k < old->n_active_zmips; k++) {
+		int izmip = old->active_zmips[k];
+		if (active[izmip])
+			continue;
+		if (zmips[izmip].sysex_state != SYSEX_IDLE)
+			zmip_sysex_reset(zmips + izmip);
+		if (zmips[izmip].note_owners && (old->zmips[izmip].flags & FLAG_ZMIP_ACTIVE_CHAIN))
+			zmips_notes_release |= 1ULL << izmip;
+	}
+}
+
+// Claim the last published snapshot, if any. Called from jack process at the start of each cycle!
+// Once claimed, writers don't reuse it until another snapshot is claimed.
+struct router_config_st * get_router_config() {
+	struct router_config_st * cfg = __atomic_exchange_n(&router_config_pending, NULL, __ATOMIC_ACQ_REL);
+	if (cfg) {
+		if (router_config)
+			zmips_release_inactive(router_config, cfg);
+		__atomic_store_n(&router_config, cfg, __ATOMIC_RELEASE);
+	}
+	return router_config;
+}
+
 //-----------------------------------------------------------------------------
 // Global settings management
 //-----------------------------------------------------------------------------
@@ -123,7 +522,9 @@ void set_active_chain(int iz) {
 		return;
 	}
 	if (iz != active_chain) {
+		router_config_begin();
 		active_chain = iz;
+		router_config_commit();
 	}
 }
 
@@ -132,7 +533,9 @@ int get_active_chain() {
 }
 
 void set_active_midi_chan(int flag) {
+	router_config_begin();
 	active_midi_chan = flag;
+	router_config_commit();
 }
 
 int get_active_midi_chan() {
@@ -142,14 +545,18 @@ int get_active_midi_chan() {
 // Global tuning based in MIDI pitch-bending
 void set_tuning_freq(double freq) {
 	if (freq == 440.0) {
+		router_config_begin();
 		tuning_pitchbend = -1;
+		router_config_commit();
 		// Clear pitchbend already applied
 		for (int i = 0; i < 16; ++i)
 			zmip_send_pitchbend_change(ZMIP_FAKE_UI, i, 0x2000); //!@todo Ideally reset only playing channels to current pitchbend offset
 	} else {
 		double pb = 6 * log((double)freq / 440.0) / log(2.0);
 		if (pb < 1.0 && pb > -1.0) {
+			router_config_begin();
 			tuning_pitchbend = ((int)(8192.0 * (1.0 + pb))) & 0x3FFF;
+			router_config_commit();
 			fprintf(stderr, "ZynMidiRouter: MIDI tuning frequency set to %f Hz (%d)\n", freq, tuning_pitchbend);
 		} else {
 			fprintf(stderr, "ZynMidiRouter: MIDI tuning frequency (%f) out of range!\n", freq);
@@ -161,8 +568,9 @@ int get_tuning_pitchbend() {
 	return tuning_pitchbend;
 }
 
+// This is called from jack process!! => Use the snapshot's tuning
 int get_tuned_pitchbend(int pb) {
-	int tpb = tuning_pitchbend + pb - 8192;
+	int tpb = router_config->tuning_pitchbend + pb - 8192;
 	if (tpb < 0)
 		tpb = 0;
 	else if (tpb > 16383)
@@ -175,7 +583,9 @@ void set_midi_master_chan(int chan) {
 		fprintf(stderr, "ZynMidiRouter: MIDI Master channel (%d) is out of range!\n",chan);
 		return;
 	}
+	router_config_begin();
 	midi_master_chan = chan;
+	router_config_commit();
 }
 
 int get_midi_master_chan() {
@@ -184,7 +594,9 @@ int get_midi_master_chan() {
 
 // Enable/Disable System messages globally
 void set_midi_system_events(int flag) {
+	router_config_begin();
 	midi_system_events = flag;
+	router_config_commit();
 }
 
 int get_midi_system_events() {
@@ -193,7 +605,9 @@ int get_midi_system_events() {
 
 // MIDI Learning Mode
 void set_midi_learning_mode(int mlm) {
+	router_config_begin();
 	midi_learning_mode = mlm;
+	router_config_commit();
 }
 
 int get_midi_learning_mode() {
@@ -220,13 +634,39 @@ int validate_midi_event(midi_event_t *ev) {
 	return 1;
 }
 
+// Event map entry in writer side filter. Event must be validated.
+static midi_event_t *midi_filter_event(int ifilter, midi_event_t *ev_from) {
+	return &midi_filters[ifilter].filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num];
+}
+
+// Edit writer side filter. Called with router_config_mutex held.
+
+static void midi_filter_set_event_map(int ifilter, midi_event_t *ev_from, midi_event_t *ev_to) {
+	midi_event_t *event_map = midi_filter_event(ifilter, ev_from);
+	event_map->type = ev_to->type;
+	event_map->chan = ev_to->chan;
+	event_map->num = ev_to->num;
+	midi_filters[ifilter].dirty = 1;
+}
+
+static void midi_filter_set_event_ignore(int ifilter, midi_event_t *ev_from) {
+	midi_filter_event(ifilter, ev_from)->type = IGNORE_EVENT;
+	midi_filters[ifilter].dirty = 1;
+}
+
+static void midi_filter_del_event_map(int ifilter, midi_event_t *ev_from) {
+	midi_event_t *event_map = midi_filter_event(ifilter, ev_from);
+	event_map->type = THRU_EVENT;
+	event_map->chan = ev_from->chan;
+	event_map->num = ev_from->num;
+	midi_filters[ifilter].dirty = 1;
+}
+
 void set_midi_filter_event_map_st(midi_event_t *ev_from, midi_event_t *ev_to) {
 	if (validate_midi_event(ev_from) && validate_midi_event(ev_to)) {
-		//memcpy(&midi_filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num],ev_to,sizeof(ev_to));
-		midi_event_t *event_map=&midi_filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num];
-		event_map->type = ev_to->type;
-		event_map->chan = ev_to->chan;
-		event_map->num = ev_to->num;
+		router_config_begin();
+		midi_filter_set_event_map(MIDI_FILTER_GLOBAL, ev_from, ev_to);
+		router_config_commit();
 	}
 }
 
@@ -238,7 +678,9 @@ void set_midi_filter_event_map(midi_event_type type_from, uint8_t chan_from, uin
 
 void set_midi_filter_event_ignore_st(midi_event_t *ev_from) {
 	if (validate_midi_event(ev_from)) {
-		midi_filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num].type = IGNORE_EVENT;
+		router_config_begin();
+		midi_filter_set_event_ignore(MIDI_FILTER_GLOBAL, ev_from);
+		router_config_commit();
 	}
 }
 
@@ -249,7 +691,7 @@ void set_midi_filter_event_ignore(midi_event_type type_from, uint8_t chan_from,
 
 midi_event_t *get_midi_filter_event_map_st(midi_event_t *ev_from) {
 	if (validate_midi_event(ev_from)) {
-		return &midi_filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num];
+		return midi_filter_event(MIDI_FILTER_GLOBAL, ev_from);
 	}
 	return NULL;
 }
@@ -261,9 +703,9 @@ midi_event_t *get_midi_filter_event_map(midi_event_type type_from, uint8_t chan_
 
 void del_midi_filter_event_map_st(midi_event_t *ev_from) {
 	if (validate_midi_event(ev_from)) {
-		midi_filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num].type = THRU_EVENT;
-		midi_filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num].chan = ev_from->chan;
-		midi_filter.event_map[ev_from->type&0x7][ev_from->chan][ev_from->num].num = ev_from->num;
+		router_config_begin();
+		midi_filter_del_event_map(MIDI_FILTER_GLOBAL, ev_from);
+		router_config_commit();
 	}
 }
 
@@ -274,12 +716,78 @@ void del_midi_filter_event_map(midi_event_type type_from, uint8_t chan_from, uin
 
 void reset_midi_filter_event_map() {
 	int i, j, k;
+	router_config_begin();
+	midi_filter_t * filter = &midi_filters[MIDI_FILTER_GLOBAL].filter;
 	for (i = 0; i < 8; i++) {
 		for (j = 0; j < 16; j++) {
 			for (k = 0; k < 128; k++) {
-				midi_filter.event_map[i][j][k].type = THRU_EVENT;
-				midi_filter.event_map[i][j][k].chan = j;
-				midi_filter.event_map[i][j][k].num = k;
+				filter->event_map[i][j][k].type = THRU_EVENT;
+				filter->event_map[i][j][k].chan = j;
+				filter->event_map[i][j][k].num = k;
+			}
+		}
+	}
+	midi_filters[MIDI_FILTER_GLOBAL].dirty = 1;
+	router_config_commit();
+}
+
+// Range rules => Single snapshot for the whole range
+
+// Check that a range mapping doesn't shift target numbers beyond 127
+static int midi_filter_range_fits(uint8_t num_first, uint8_t num_last, uint8_t num_to_first) {
+	int last = num_last > 127 ? 127 : num_last;
+	if (last >= num_first && num_to_first + last - num_first > 127) {
+		fprintf(stderr, "ZynMidiRouter: MIDI filter range target overflows (%d-%d => %d).\n", num_first, num_last, num_to_first);
+		return 0;
+	}
+	return 1;
+}
+
+void set_midi_filter_event_range_map(midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last, midi_event_type type_to, uint8_t chan_to, uint8_t num_to_first) {
+	if (!midi_filter_range_fits(num_first, num_last, num_to_first))
+		return;
+	router_config_begin();
+	for (int num = num_first; num <= num_last && num < 128; num++)
+		set_midi_filter_event_map(type_from, chan_from, num, type_to, chan_to, num_to_first + num - num_first);
+	router_config_commit();
+}
+
+void set_midi_filter_event_range_ignore(midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last) {
+	router_config_begin();
+	for (int num = num_first; num <= num_last && num < 128; num++)
+		set_midi_filter_event_ignore(type_from, chan_from, num);
+	router_config_commit();
+}
+
+void del_midi_filter_event_range_map(midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last) {
+	router_config_begin();
+	for (int num = num_first; num <= num_last && num < 128; num++)
+		del_midi_filter_event_map(type_from, chan_from, num);
+	router_config_commit();
+}
+
+// Compile the writer side filter for jack process => keep rows having rules only
+void midi_filter_compile(midi_filter_t * filter, midi_filter_rules_t * rules) {
+	rules->n_rows = 0;
+	for (int i = 0; i < 8; i++) {
+		rules->has_rules[i] = 0;
+		for (int j = 0; j < 16; j++) {
+			midi_event_t * event_map = filter->event_map[i][j];
+			int k;
+			for (k = 0; k < 128; k++) {
+				if (event_map[k].type != THRU_EVENT)
+					break;
+			}
+			if (k == 128)
+				continue;
+			rules->has_rules[i] |= 1 << j;
+			rules->row[i][j] = rules->n_rows;
+			midi_filter_entry_t * row = rules->rows[rules->n_rows++];
+			for (k = 0; k < 128; k++) {
+				row[k].type = event_map[k].type;
+				row[k].chan = event_map[k].chan;
+				row[k].num = event_map[k].num;
+				row[k].reserved = 0;
 			}
 		}
 	}
@@ -305,61 +813,290 @@ void del_midi_filter_cc_map(uint8_t chan_from, uint8_t cc_from) {
 	del_midi_filter_event_map(CTRL_CHANGE, chan_from, cc_from);
 }
 
+void set_midi_filter_cc_range_map(uint8_t chan_from, uint8_t cc_first, uint8_t cc_last, uint8_t chan_to, uint8_t cc_to_first) {
+	set_midi_filter_event_range_map(CTRL_CHANGE, chan_from, cc_first, cc_last, CTRL_CHANGE, chan_to, cc_to_first);
+}
+
+void del_midi_filter_cc_range_map(uint8_t chan_from, uint8_t cc_first, uint8_t cc_last) {
+	del_midi_filter_event_range_map(CTRL_CHANGE, chan_from, cc_first, cc_last);
+}
+
 void reset_midi_filter_cc_map() {
 	int i, j;
+	router_config_begin();
 	for (i = 0; i < 16; i++) {
 		for (j = 0; j < 128; j++) {
 			del_midi_filter_event_map(CTRL_CHANGE, i, j);
 		}
 	}
+	router_config_commit();
+}
+
+// MIDI filter by input port
+
+// Release zmip's filter => back to global filter. Called with router_config_mutex held.
+static void zmip_release_midi_filter(int iz) {
+	int ifilter = zmips[iz].midi_filter;
+	if (ifilter != MIDI_FILTER_GLOBAL)
+		midi_filters[ifilter].refs--;
+	zmips[iz].midi_filter = MIDI_FILTER_GLOBAL;
+}
+
+// Get a filter owned by zmip, for editing => copy-on-write.
+// Called with router_config_mutex held. Returns -1 if there is no free filter.
+static int zmip_own_midi_filter(int iz) {
+	int ifilter = zmips[iz].midi_filter;
+	if (ifilter != MIDI_FILTER_GLOBAL && midi_filters[ifilter].refs == 1)
+		return ifilter;
+	int inew;
+	for (inew = 1; inew < MAX_NUM_MIDI_FILTERS; inew++) {
+		if (midi_filters[inew].refs == 0)
+			break;
+	}
+	if (inew >= MAX_NUM_MIDI_FILTERS) {
+		fprintf(stderr, "ZynMidiRouter: No free MIDI filter for input port (%d).\n", iz);
+		return -1;
+	}
+	memcpy(&midi_filters[inew].filter, &midi_filters[ifilter].filter, sizeof(midi_filter_t));
+	midi_filters[inew].dirty = 1;
+	midi_filters[inew].refs = 1;
+	zmip_release_midi_filter(iz);
+	zmips[iz].midi_filter = inew;
+	return inew;
+}
+
+int zmip_set_midi_filter_event_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from, midi_event_type type_to, uint8_t chan_to, uint8_t num_to) {
+	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return 0;
+	}
+	midi_event_t ev_from = { .type = type_from, .chan = chan_from, .num = num_from };
+	midi_event_t ev_to = { .type = type_to, .chan = chan_to, .num = num_to };
+	if (!validate_midi_event(&ev_from) || !validate_midi_event(&ev_to))
+		return 0;
+	router_config_begin();
+	int ifilter = zmip_own_midi_filter(iz);
+	if (ifilter >= 0)
+		midi_filter_set_event_map(ifilter, &ev_from, &ev_to);
+	router_config_commit();
+	return ifilter >= 0;
+}
+
+int zmip_set_midi_filter_event_ignore(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from) {
+	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return 0;
+	}
+	midi_event_t ev_from = { .type = type_from, .chan = chan_from, .num = num_from };
+	if (!validate_midi_event(&ev_from))
+		return 0;
+	router_config_begin();
+	int ifilter = zmip_own_midi_filter(iz);
+	if (ifilter >= 0)
+		midi_filter_set_event_ignore(ifilter, &ev_from);
+	router_config_commit();
+	return ifilter >= 0;
+}
+
+midi_event_t *zmip_get_midi_filter_event_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from) {
+	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return NULL;
+	}
+	midi_event_t ev_from = { .type = type_from, .chan = chan_from, .num = num_from };
+	if (!validate_midi_event(&ev_from))
+		return NULL;
+	return midi_filter_event(zmips[iz].midi_filter, &ev_from);
+}
+
+int zmip_del_midi_filter_event_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from) {
+	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return 0;
+	}
+	midi_event_t ev_from = { .type = type_from, .chan = chan_from, .num = num_from };
+	if (!validate_midi_event(&ev_from))
+		return 0;
+	router_config_begin();
+	int ifilter = zmip_own_midi_filter(iz);
+	if (ifilter >= 0)
+		midi_filter_del_event_map(ifilter, &ev_from);
+	router_config_commit();
+	return ifilter >= 0;
+}
+
+int zmip_set_midi_filter_event_range_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last, midi_event_type type_to, uint8_t chan_to, uint8_t num_to_first) {
+	if (!midi_filter_range_fits(num_first, num_last, num_to_first))
+		return 0;
+	int res = 1;
+	router_config_begin();
+	for (int num = num_first; num <= num_last && num < 128 && res; num++)
+		res = zmip_set_midi_filter_event_map(iz, type_from, chan_from, num, type_to, chan_to, num_to_first + num - num_first);
+	router_config_commit();
+	return res;
+}
+
+int zmip_del_midi_filter_event_range_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last) {
+	int res = 1;
+	router_config_begin();
+	for (int num = num_first; num <= num_last && num < 128 && res; num++)
+		res = zmip_del_midi_filter_event_map(iz, type_from, chan_from, num);
+	router_config_commit();
+	return res;
+}
+
+int zmip_set_midi_filter_cc_map(int iz, uint8_t chan_from, uint8_t cc_from, uint8_t chan_to, uint8_t cc_to) {
+	return zmip_set_midi_filter_event_map(iz, CTRL_CHANGE, chan_from, cc_from, CTRL_CHANGE, chan_to, cc_to);
+}
+
+int zmip_set_midi_filter_cc_ignore(int iz, uint8_t chan_from, uint8_t cc_from) {
+	return zmip_set_midi_filter_event_ignore(iz, CTRL_CHANGE, chan_from, cc_from);
+}
+
+int zmip_del_midi_filter_cc_map(int iz, uint8_t chan_from, uint8_t cc_from) {
+	return zmip_del_midi_filter_event_map(iz, CTRL_CHANGE, chan_from, cc_from);
+}
+
+int zmip_share_midi_filter(int iz, int iz_src) {
+	if (iz < 0 || iz >= MAX_NUM_ZMIPS || iz_src < 0 || iz_src >= MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d, %d).\n", iz, iz_src);
+		return 0;
+	}
+	router_config_begin();
+	int ifilter = zmips[iz_src].midi_filter;
+	if (ifilter != zmips[iz].midi_filter) {
+		zmip_release_midi_filter(iz);
+		if (ifilter != MIDI_FILTER_GLOBAL)
+			midi_filters[ifilter].refs++;
+		zmips[iz].midi_filter = ifilter;
+	}
+	router_config_commit();
+	return 1;
+}
+
+int zmip_reset_midi_filter(int iz) {
+	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return 0;
+	}
+	router_config_begin();
+	zmip_release_midi_filter(iz);
+	router_config_commit();
+	return 1;
+}
+
+int zmip_get_midi_filter(int iz) {
+	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
+		return -1;
+	}
+	return zmips[iz].midi_filter;
 }
 
 // -----------------------------------------------------------------------------
 // MIDI Input Ports management
 // -----------------------------------------------------------------------------
 
+// Release direct input lanes & their buffers, allocated or not
+static void zmip_free_lanes(struct zmip_lane_st * lanes) {
+	if (!lanes)
+		return;
+	for (int i = 0; i < NUM_ZMIP_LANES; i++) {
+		if (lanes[i].rbuffer) {
+			router_rt_memory_remove(lanes[i].rbuffer->buf);
+			jack_ringbuffer_free(lanes[i].rbuffer);
+		}
+		router_rt_memory_remove(lanes[i].wrap_buffer);
+		free(lanes[i].wrap_buffer);
+	}
+	router_rt_memory_remove(lanes);
+	free(lanes);
+}
+
+// Create direct input lanes. Returns NULL on error, with nothing left allocated.
+static struct zmip_lane_st * zmip_create_lanes() {
+	struct zmip_lane_st * lanes = calloc(NUM_ZMIP_LANES, sizeof(struct zmip_lane_st));
+	if (!lanes) {
+		fprintf(stderr, "ZynMidiRouter: Error allocating ZMIP lanes.\n");
+		return NULL;
+	}
+	for (int i = 0; i < NUM_ZMIP_LANES; i++) {
+		struct zmip_lane_st * lane = lanes + i;
+		lane->event.time = 0xFFFFFFFF;
+		// Each lane needs its own wrap buffer, as events from all lanes are pending at the same time
+		lane->wrap_buffer = malloc(JACK_MIDI_BUFFER_SIZE);
+		if (!lane->wrap_buffer) {
+			fprintf(stderr, "ZynMidiRouter: Error allocating ZMIP lane wrap buffer.\n");
+			zmip_free_lanes(lanes);
+			return NULL;
+		}
+		lane->rbuffer = jack_ringbuffer_create(JACK_MIDI_BUFFER_SIZE);
+		if (!lane->rbuffer) {
+			fprintf(stderr, "ZynMidiRouter: Error creating ZMIP ring-buffer.\n");
+			zmip_free_lanes(lanes);
+			return NULL;
+		}
+		// lock the buffer into memory, this is *NOT* realtime safe, do it before using the buffer!
+		if (jack_ringbuffer_mlock(lane->rbuffer)) {
+			fprintf(stderr, "ZynMidiRouter: Error locking memory for ZMIP ring-buffer.\n");
+			zmip_free_lanes(lanes);
+			return NULL;
+		}
+		router_rt_memory_add("zmip lane wrap buffer", lane->wrap_buffer, JACK_MIDI_BUFFER_SIZE);
+		router_rt_memory_add_locked("zmip lane ring-buffer", lane->rbuffer->buf, lane->rbuffer->size);
+	}
+	router_rt_memory_add("zmip lanes", lanes, NUM_ZMIP_LANES * sizeof(struct zmip_lane_st));
+	return lanes;
+}
+
 int zmip_init(int iz, char *name, uint32_t flags) {
 	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
 		fprintf(stderr, "ZynMidiRouter: Bad index (%d) initializing input port '%s'.\n", iz, name);
 		return 0;
 	}
 
+	// Create direct input lanes before publishing the DIRECTIN flag
+	struct zmip_lane_st * lanes = NULL;
+	if (flags & FLAG_ZMIP_DIRECTIN) {
+		lanes = zmip_create_lanes();
+		if (!lanes)
+			return 0;
+	}
+
 	if (name != NULL) {
 		//Create Jack Output Port
 		zmips[iz].jport = jack_port_register(jack_client, name, JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
 		if (zmips[iz].jport == NULL) {
 			fprintf(stderr, "ZynMidiRouter: Error creating jack midi input port '%s'.\n", name);
+			zmip_free_lanes(lanes);
 			return 0;
 		}
 	} else {
 		zmips[iz].jport = NULL;
 	}
+	router_stats_set_name(router_stats->zmips + iz, name);
 
 	//Set initial values
+	router_config_begin();
 	zmips[iz].buffer = NULL;
-	zmips[iz].rbuffer = NULL;
+	zmips[iz].lanes = lanes;
+	zmips[iz].lane = NULL;
+	zmip_sysex_reset(zmips + iz);
 	zmips[iz].event.buffer = NULL;
 	zmips[iz].event.time = 0xFFFFFFFF;
 	zmips[iz].event_count = 0;
+	zmips[iz].n_connections = 0;
+	zmips[iz].registered = 1;
 	zmips[iz].flags = flags;
+	zmip_release_midi_filter(iz);
 	memset(zmips[iz].ctrl_mode, CTRL_MODE_ABS, 16 * 128);
 	memset(zmips[iz].ctrl_relmode_count, 0, 16 * 128);
 	memset(zmips[iz].last_ctrl_val, 0, 16 * 128);
-
-	// Create direct input ring-buffer
-	if (flags & FLAG_ZMIP_DIRECTIN) {
-		zmips[iz].rbuffer = jack_ringbuffer_create(JACK_MIDI_BUFFER_SIZE);
-		if (!zmips[iz].rbuffer) {
-			fprintf(stderr, "ZynMidiRouter: Error creating ZMIP ring-buffer.\n");
-			return 0;
-		}
-		// lock the buffer into memory, this is *NOT* realtime safe, do it before using the buffer!
-		if (jack_ringbuffer_mlock(zmips[iz].rbuffer)) {
-			fprintf(stderr, "ZynMidiRouter: Error locking memory for ZMIP ring-buffer.\n");
-			return 0;
-		}
-	}
-
+	if (zmips[iz].note_owners)
+		memset(zmips[iz].note_owners, 0, 16 * sizeof(*zmips[iz].note_owners));
+	else if (flags & FLAG_ZMIP_ACTIVE_CHAIN)
+		zmip_alloc_note_owners(iz);
+	router_config_commit();
 	return 1;
 }
 
@@ -368,24 +1105,150 @@ int zmip_end(int iz) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
 		return 0;
 	}
+	router_stats_set_name(router_stats->zmips + iz, NULL);
+	zmips[iz].registered = 0;
 	zmips[iz].buffer = NULL;
-	if (zmips[iz].rbuffer) {
-		jack_ringbuffer_free(zmips[iz].rbuffer);
-		zmips[iz].rbuffer = NULL;
+	// Jack process doesn't use it anymore => return an unfinished SysEx buffer to the pool
+	zmip_sysex_reset(zmips + iz);
+	zmip_free_lanes(zmips[iz].lanes);
+	zmips[iz].lanes = NULL;
+	if (zmips[iz].note_owners) {
+		router_rt_memory_remove(zmips[iz].note_owners);
+		free(zmips[iz].note_owners);
+		zmips[iz].note_owners = NULL;
+	}
+	return 1;
+}
+
+// Allocate the note ownership table of an ACTI zmip, if it has none yet. Call it before
+// publishing the flag. It's kept until zmip_end, as jack process may be using it.
+int zmip_alloc_note_owners(int iz) {
+	if (zmips[iz].note_owners)
+		return 1;
+	zmips[iz].note_owners = calloc(16, sizeof(*zmips[iz].note_owners));
+	if (!zmips[iz].note_owners) {
+		fprintf(stderr, "ZynMidiRouter: Error allocating note owners for input port (%d).\n", iz);
+		return 0;
 	}
+	router_rt_memory_add("zmip note owners", zmips[iz].note_owners, 16 * sizeof(*zmips[iz].note_owners));
 	return 1;
 }
 
+// Get the lane to be used by the calling thread for writing to a direct input.
+// Leases a free lane on first use. Returns 0 (shared lane) if there is no free lane.
+int zmip_get_lane(int iz) {
+	int il = zmip_lane_leased[iz];
+	if (il)
+		return il;
+	uintptr_t self = (uintptr_t)pthread_self();
+	for (il = 1; il < NUM_ZMIP_LANES; il++) {
+		uintptr_t free_owner = 0;
+		if (__atomic_compare_exchange_n(&zmips[iz].lanes[il].owner, &free_owner, self, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			zmip_lane_leased[iz] = il;
+			// Just to get the lanes released when the thread exits
+			pthread_setspecific(zmip_lane_key, (void *)1);
+			return il;
+		}
+	}
+	return 0;
+}
+
+// Release lanes leased by the calling thread. Called when a thread that leased lanes exits.
+void zmip_release_lanes(void * arg) {
+	for (int iz = 0; iz < MAX_NUM_ZMIPS; iz++) {
+		int il = zmip_lane_leased[iz];
+		if (il && zmips[iz].lanes) {
+			__atomic_store_n(&zmips[iz].lanes[il].owner, 0, __ATOMIC_RELEASE);
+			zmip_lane_leased[iz] = 0;
+		}
+	}
+}
+
 int zmip_get_num_devs() {
 	return NUM_ZMIP_DEVS;
 }
 
+// Device slots registry
+
+int zmip_get_max_devs() {
+	return NUM_ZMIP_DEVS + NUM_ZMIP_DEVS_EXT;
+}
+
+int zmip_get_dev_index(int idev) {
+	if (idev < 0 || idev >= NUM_ZMIP_DEVS + NUM_ZMIP_DEVS_EXT)
+		return -1;
+	if (idev < NUM_ZMIP_DEVS)
+		return ZMIP_DEV0 + idev;
+	return ZMIP_DEV_EXT0 + idev - NUM_ZMIP_DEVS;
+}
+
+int zmip_is_dev(int iz) {
+	return (iz >= ZMIP_DEV0 && iz < ZMIP_DEV0 + NUM_ZMIP_DEVS) || (iz >= ZMIP_DEV_EXT0 && iz < ZMIP_DEV_EXT0 + NUM_ZMIP_DEVS_EXT);
+}
+
+int zmip_add_dev(char *name) {
+	char port_name[32];
+	for (int idev = 0; idev < NUM_ZMIP_DEVS + NUM_ZMIP_DEVS_EXT; idev++) {
+		int iz = zmip_get_dev_index(idev);
+		if (zmips[iz].registered)
+			continue;
+		if (name == NULL) {
+			sprintf(port_name, "dev%d_in", idev);
+			name = port_name;
+		}
+		// Not holding router_config_mutex while registering the jack port
+		if (!zmip_init(iz, name, ZMIP_DEV_FLAGS))
+			return -1;
+		// By default, all chains receive from all devices
+		router_config_begin();
+		for (int i = 0; i < ZMOP_CTRL; i++)
+			zmop_set_route_from(i, iz, 1);
+		router_config_commit();
+		return iz;
+	}
+	fprintf(stderr, "ZynMidiRouter: No free input device slot.\n");
+	return -1;
+}
+
+int zmip_remove_dev(int iz) {
+	if (!zmip_is_dev(iz) || !zmips[iz].registered) {
+		fprintf(stderr, "ZynMidiRouter: Bad input device index (%d).\n", iz);
+		return 0;
+	}
+	// Drop it from configuration & wait until jack process doesn't use it
+	router_config_begin();
+	jack_port_t * jport = zmips[iz].jport;
+	zmips[iz].registered = 0;
+	zmips[iz].n_connections = 0;
+	zmip_release_midi_filter(iz);
+	for (int i = 0; i < MAX_NUM_ZMOPS; i++)
+		zmops[i].route_from_zmips[iz] = 0;
+	router_config_commit();
+	if (!router_config_sync()) {
+		// Jack process could be stalled in the middle of using them => leak them, as zmop_remove_dev does
+		fprintf(stderr, "ZynMidiRouter: Jack process not running, input device buffers not released.\n");
+		zmips[iz].sysex = NULL;
+		zmips[iz].lanes = NULL;
+		zmips[iz].note_owners = NULL;
+	}
+	// Not holding router_config_mutex, as jack could call jack_connect_cb
+	zmip_end(iz);
+	zmips[iz].jport = NULL;
+	if (jport)
+		jack_port_unregister(jack_client, jport);
+	return 1;
+}
+
 int zmip_set_flags(int iz, uint32_t flags) {
 	if (iz < 0 || iz >= MAX_NUM_ZMIPS) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
+	if (flags & FLAG_ZMIP_ACTIVE_CHAIN)
+		zmip_alloc_note_owners(iz);
 	zmips[iz].flags = flags;
+	router_config_commit();
 	return 1;
 }
 
@@ -410,10 +1273,12 @@ int zmip_set_flag_cc_auto_mode(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmips[iz].flags |= (uint32_t)FLAG_ZMIP_CC_AUTO_MODE;
 	else
 		zmips[iz].flags &= ~(uint32_t)FLAG_ZMIP_CC_AUTO_MODE;
+	router_config_commit();
 	return 1;
 }
 
@@ -430,10 +1295,14 @@ int zmip_set_flag_active_chain(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port number (%d).\n", iz);
 		return 0;
 	}
-	if (flag)
+	router_config_begin();
+	if (flag) {
+		zmip_alloc_note_owners(ZMIP_DEV0 + iz);
 		zmips[ZMIP_DEV0 + iz].flags |= (uint32_t)FLAG_ZMIP_ACTIVE_CHAIN;
-	else
+	} else {
 		zmips[ZMIP_DEV0 + iz].flags &= ~(uint32_t)FLAG_ZMIP_ACTIVE_CHAIN;
+	}
+	router_config_commit();
 	//fprintf(stderr, "ZynMidiRouter: Flags for zmip (%d) => %x\n", iz, zmips[ZMIP_DEV0 + iz].flags);
 	return 1;
 }
@@ -452,9 +1321,14 @@ int zmip_set_route_chains(int iz, int route) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	for (int i = 0; i < ZMOP_CTRL; i++) {
-		if (!zmop_set_route_from(i, iz, route)) return 0;
+		if (!zmop_set_route_from(i, iz, route)) {
+			router_config_commit();
+			return 0;
+		}
 	}
+	router_config_commit();
 	return 1;
 }
 
@@ -462,9 +1336,46 @@ int zmip_set_route_chains(int iz, int route) {
 // MIDI Output Ports management
 //-----------------------------------------------------------------------------
 
-int zmop_init(int iz, char *name, uint32_t flags) {
+// Held notes tracking => bitsets per MIDI channel
+
+void zmop_note_on(struct zmop_st * zmop, uint8_t chan, uint8_t note) {
+	zmop->note_bits[chan][note >> 6] |= 1ULL << (note & 0x3F);
+	zmop->note_chans |= 1 << chan;
+}
+
+void zmop_note_off(struct zmop_st * zmop, uint8_t chan, uint8_t note) {
+	uint64_t * bits = zmop->note_bits[chan];
+	bits[note >> 6] &= ~(1ULL << (note & 0x3F));
+	if (!(bits[0] | bits[1]))
+		zmop->note_chans &= ~(1 << chan);
+}
+
+// Note held in any MIDI channel
+int zmop_note_held(struct zmop_st * zmop, uint8_t note) {
+	uint16_t chans = zmop->note_chans;
+	while (chans) {
+		int chan = __builtin_ctz(chans);
+		chans &= chans - 1;
+		if (zmop->note_bits[chan][note >> 6] & (1ULL << (note & 0x3F)))
+			return 1;
+	}
+	return 0;
+}
+
+int zmop_get_num_held_notes(int iz) {
 	if (iz < 0 || iz >= MAX_NUM_ZMOPS) {
-		fprintf(stderr, "ZynMidiRouter: Bad index (%d) initializing ouput port '%s'.\n", iz, name);
+		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
+		return 0;
+	}
+	int n = 0;
+	for (int chan = 0; chan < 16; chan++)
+		n += __builtin_popcountll(zmops[iz].note_bits[chan][0]) + __builtin_popcountll(zmops[iz].note_bits[chan][1]);
+	return n;
+}
+
+int zmop_init(int iz, char *name, uint32_t flags) {
+	if (iz < 0 || iz >= MAX_NUM_ZMOPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad index (%d) initializing ouput port '%s'.\n", iz, name);
 		return 0;
 	}
 
@@ -478,17 +1389,22 @@ int zmop_init(int iz, char *name, uint32_t flags) {
 	} else {
 		zmops[iz].jport = NULL;
 	}
+	router_stats_set_name(router_stats->zmops + iz, name);
 
 	// Set initial values
+	router_config_begin();
 	zmops[iz].buffer = NULL;
 	zmops[iz].rbuffer = NULL;
 	zmops[iz].n_connections = 0;
+	zmops[iz].registered = 1;
+	zmops[iz].live = 0;
 	zmops[iz].flags = flags;
 	zmops[iz].note_low = 0;
 	zmops[iz].note_high = 127;
 	zmops[iz].transpose_octave = 0;
 	zmops[iz].transpose_semitone = 0;
-	memset(zmops[iz].note_state, 0, 128);
+	memset(zmops[iz].note_bits, 0, sizeof(zmops[iz].note_bits));
+	zmops[iz].note_chans = 0;
 	memset(zmops[iz].note_transpose, 0, 128);
 	int i;
 	for (i = 0; i < 16; i++) {
@@ -498,6 +1414,15 @@ int zmop_init(int iz, char *name, uint32_t flags) {
 		zmops[iz].cc_route[i] = 0;
 	}
 
+	// Reset MIDI channels
+	zmop_reset_midi_chans(iz);
+
+	// Reset routes
+	for (i = 0; i < MAX_NUM_ZMIPS; i++) {
+		zmops[iz].route_from_zmips[i] = 0;
+	}
+	router_config_commit();
+
 	// Create direct output ring-buffer
 	if (flags & FLAG_ZMOP_DIRECTOUT) {
 		zmops[iz].rbuffer = jack_ringbuffer_create(JACK_MIDI_BUFFER_SIZE);
@@ -510,14 +1435,7 @@ int zmop_init(int iz, char *name, uint32_t flags) {
 			fprintf(stderr, "ZynMidiRouter: Error locking memory for ZMOP ring-buffer.\n");
 			return 0;
 		}
-	}
-
-	// Reset MIDI channels
-	zmop_reset_midi_chans(iz);
-
-	// Reset routes
-	for (i = 0; i < MAX_NUM_ZMIPS; i++) {
-		zmops[iz].route_from_zmips[i] = 0;
+		router_rt_memory_add_locked("zmop ring-buffer", zmops[iz].rbuffer->buf, zmops[iz].rbuffer->size);
 	}
 
 	return 1;
@@ -528,8 +1446,11 @@ int zmop_end(int iz) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_stats_set_name(router_stats->zmops + iz, NULL);
+	zmops[iz].registered = 0;
 	zmops[iz].buffer = NULL;
 	if (zmops[iz].rbuffer) {
+		router_rt_memory_remove(zmops[iz].rbuffer->buf);
 		jack_ringbuffer_free(zmops[iz].rbuffer);
 		zmops[iz].rbuffer = NULL;
 	}
@@ -544,6 +1465,79 @@ int zmop_get_num_devs() {
 	return NUM_ZMOP_DEVS;
 }
 
+// Device slots registry
+
+int zmop_get_max_devs() {
+	return NUM_ZMOP_DEVS + NUM_ZMOP_DEVS_EXT;
+}
+
+int zmop_get_dev_index(int idev) {
+	if (idev < 0 || idev >= NUM_ZMOP_DEVS + NUM_ZMOP_DEVS_EXT)
+		return -1;
+	if (idev < NUM_ZMOP_DEVS)
+		return ZMOP_DEV0 + idev;
+	return ZMOP_DEV_EXT0 + idev - NUM_ZMOP_DEVS;
+}
+
+int zmop_is_dev(int iz) {
+	return (iz >= ZMOP_DEV0 && iz < ZMOP_DEV0 + NUM_ZMOP_DEVS) || (iz >= ZMOP_DEV_EXT0 && iz < ZMOP_DEV_EXT0 + NUM_ZMOP_DEVS_EXT);
+}
+
+int zmop_add_dev(char *name) {
+	char port_name[32];
+	for (int idev = 0; idev < NUM_ZMOP_DEVS + NUM_ZMOP_DEVS_EXT; idev++) {
+		int iz = zmop_get_dev_index(idev);
+		if (zmops[iz].registered)
+			continue;
+		if (name == NULL) {
+			sprintf(port_name, "dev%d_out", idev);
+			name = port_name;
+		}
+		// Not holding router_config_mutex while registering the jack port
+		if (!zmop_init(iz, name, FLAG_ZMOP_DIRECTOUT))
+			return -1;
+		zmop_set_midi_chan_all(iz);
+		return iz;
+	}
+	fprintf(stderr, "ZynMidiRouter: No free output device slot.\n");
+	return -1;
+}
+
+// Direct output ring-buffer is freed, once senders & jack process are done with it
+int zmop_remove_dev(int iz) {
+	if (!zmop_is_dev(iz) || !zmops[iz].registered) {
+		fprintf(stderr, "ZynMidiRouter: Bad output device index (%d).\n", iz);
+		return 0;
+	}
+	// Drop it from configuration & wait until jack process doesn't use it
+	router_config_begin();
+	jack_port_t * jport = zmops[iz].jport;
+	zmops[iz].registered = 0;
+	zmops[iz].n_connections = 0;
+	router_config_commit();
+	int synced = router_config_sync();
+	// Detach the ring-buffer from senders
+	pthread_mutex_lock(&zmop_send_mutex);
+	jack_ringbuffer_t * rbuffer = zmops[iz].rbuffer;
+	zmops[iz].rbuffer = NULL;
+	pthread_mutex_unlock(&zmop_send_mutex);
+	// Not holding router_config_mutex, as jack could call jack_connect_cb
+	zmop_end(iz);
+	zmops[iz].jport = NULL;
+	if (rbuffer) {
+		if (synced) {
+			router_rt_memory_remove(rbuffer->buf);
+			jack_ringbuffer_free(rbuffer);
+		} else {
+			// Jack process could be stalled in the middle of reading it => leak it
+			fprintf(stderr, "ZynMidiRouter: Jack process not running, output device ring-buffer not released.\n");
+		}
+	}
+	if (jport)
+		jack_port_unregister(jack_client, jport);
+	return 1;
+}
+
 // Flags management
 
 int zmop_set_flags(int iz, uint32_t flags) {
@@ -551,7 +1545,9 @@ int zmop_set_flags(int iz, uint32_t flags) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	zmops[iz].flags = flags;
+	router_config_commit();
 	return 1;
 }
 
@@ -576,10 +1572,12 @@ int zmop_set_flag_droppc(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmops[iz].flags |= (uint32_t)FLAG_ZMOP_DROPPC;
 	else
 		zmops[iz].flags &= ~(uint32_t)FLAG_ZMOP_DROPPC;
+	router_config_commit();
 	//fprintf(stderr, "ZynMidiRouter: Flags for zmop (%d) => %x\n", iz, zmops[iz].flags);
 	return 1;
 }
@@ -597,10 +1595,12 @@ int zmop_set_flag_dropcc(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmops[iz].flags |= (uint32_t)FLAG_ZMOP_DROPCC;
 	else
 		zmops[iz].flags &= ~(uint32_t)FLAG_ZMOP_DROPCC;
+	router_config_commit();
 	return 1;
 }
 
@@ -617,10 +1617,12 @@ int zmop_set_flag_dropsys(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmops[iz].flags |= (uint32_t)FLAG_ZMOP_DROPSYS;
 	else
 		zmops[iz].flags &= ~(uint32_t)FLAG_ZMOP_DROPSYS;
+	router_config_commit();
 	return 1;
 }
 
@@ -637,10 +1639,12 @@ int zmop_set_flag_dropsysex(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmops[iz].flags |= (uint32_t)FLAG_ZMOP_DROPSYSEX;
 	else
 		zmops[iz].flags &= ~(uint32_t)FLAG_ZMOP_DROPSYSEX;
+	router_config_commit();
 	return 1;
 }
 
@@ -657,10 +1661,12 @@ int zmop_set_flag_dropnote(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmops[iz].flags |= (uint32_t)FLAG_ZMOP_DROPNOTE;
 	else
 		zmops[iz].flags &= ~(uint32_t)FLAG_ZMOP_DROPNOTE;
+	router_config_commit();
 	return 1;
 }
 
@@ -677,10 +1683,12 @@ int zmop_set_flag_tuning(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmops[iz].flags |= (uint32_t)FLAG_ZMOP_TUNING;
 	else
 		zmops[iz].flags &= ~(uint32_t)FLAG_ZMOP_TUNING;
+	router_config_commit();
 	return 1;
 }
 
@@ -697,10 +1705,12 @@ int zmop_set_flag_chan_transfilter(int iz, uint8_t flag) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	if (flag)
 		zmops[iz].flags |= (uint32_t)FLAG_ZMOP_CHAN_TRANSFILTER;
 	else
 		zmops[iz].flags &= ~(uint32_t)FLAG_ZMOP_CHAN_TRANSFILTER;
+	router_config_commit();
 	//fprintf(stderr, "ZynMidiRouter: Flags for zmop (%d) => %x\n", iz, zmops[iz].flags);
 	return 1;
 }
@@ -721,11 +1731,13 @@ int zmop_reset_midi_chans(int iz) {
 		return 0;
 	}
 	int i;
+	router_config_begin();
 	for (i = 0; i < 16; i++) {
 		zmops[iz].midi_chans[i] = -1;
 	}
 	zmops[iz].midi_chan = -1;
 	zmop_set_flag_chan_transfilter(iz, 1);
+	router_config_commit();
 	return 1;
 }
 
@@ -739,12 +1751,14 @@ int zmop_set_midi_chan(int iz, int midi_chan) {
 		return 0;
 	}
 	int i;
+	router_config_begin();
 	for (i = 0; i < 16; i++) {
 		zmops[iz].midi_chans[i] = -1;
 	}
 	zmops[iz].midi_chan = midi_chan;
 	zmops[iz].midi_chans[midi_chan] = midi_chan;
 	zmop_set_flag_chan_transfilter(iz, 1);
+	router_config_commit();
 	return 1;
 }
 
@@ -762,12 +1776,14 @@ int zmop_set_midi_chan_trans(int iz, int midi_chan, int midi_chan_trans) {
 		return 0;
 	}
 	int i;
+	router_config_begin();
 	for (i = 0; i < 16; i++) {
 		zmops[iz].midi_chans[i] = -1;
 	}
 	zmops[iz].midi_chan = midi_chan;
 	zmops[iz].midi_chans[midi_chan] = midi_chan_trans;
 	zmop_set_flag_chan_transfilter(iz, 1);
+	router_config_commit();
 	return 1;
 }
 
@@ -777,11 +1793,13 @@ int zmop_set_midi_chan_all(int iz) {
 		return 0;
 	}
 	int i;
+	router_config_begin();
 	for (i = 0; i < 16; i ++) {
 		zmops[iz].midi_chans[i] = i;
 	}
 	zmops[iz].midi_chan = -1;
 	zmop_set_flag_chan_transfilter(iz, 0);
+	router_config_commit();
 	return 1;
 }
 
@@ -791,11 +1809,13 @@ int zmop_set_midi_chan_all_trans(int iz, int midi_chan) {
 		return 0;
 	}
 	int i;
+	router_config_begin();
 	for (i = 0; i < 16; i ++) {
 		zmops[iz].midi_chans[i] = midi_chan;
 	}
 	zmops[iz].midi_chan = -1;
 	zmop_set_flag_chan_transfilter(iz, 0);
+	router_config_commit();
 	return 1;
 }
 
@@ -811,7 +1831,9 @@ int zmop_set_midi_chan_to(int iz, int midi_chan_from, int midi_chan_to) {
 	if (midi_chan_to < -1 || midi_chan_to >= 16) {
 		midi_chan_to = -1;
 	}
+	router_config_begin();
 	zmops[iz].midi_chans[midi_chan_from] = midi_chan_to;
+	router_config_commit();
 	return 1;
 }
 
@@ -844,8 +1866,10 @@ int zmop_reset_routes_from(int iz) {
 		return 0;
 	}
 	int i;
+	router_config_begin();
 	for (i = 0; i < MAX_NUM_ZMIPS; i++)
 		zmops[iz].route_from_zmips[i] = 0;
+	router_config_commit();
 	return 1;
 }
 
@@ -858,7 +1882,9 @@ int zmop_set_route_from(int izmop, int izmip, int route) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", izmip);
 		return 0;
 	}
+	router_config_begin();
 	zmops[izmop].route_from_zmips[izmip] = route;
+	router_config_commit();
 	return 1;
 }
 
@@ -879,23 +1905,57 @@ int zmop_get_routes_info(int izmop, int *buffer) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", izmop);
 		return -1;
 	}
-	memcpy((void *)buffer, (void *)zmops[izmop].route_from_zmips, MAX_NUM_ZMIPS * sizeof(int));
+	memcpy((void *)buffer, (void *)zmops[izmop].route_from_zmips, ZMIP_DEV_EXT0 * sizeof(int));
 	return 1;
 }
 
+// Callers size the buffer for ZMIP_DEV_EXT0 x ZMIP_DEV_EXT0 routes => extra devices are not included
 int zmop_get_routes_info_all(int *buffer) {
 	int iz;
-	for (iz=0; iz<MAX_NUM_ZMIPS; iz++) {
+	for (iz=0; iz<ZMIP_DEV_EXT0; iz++) {
+		memcpy((void *)buffer, (void *)zmops[iz].route_from_zmips, ZMIP_DEV_EXT0 * sizeof(int));
+		buffer += ZMIP_DEV_EXT0;
+	}
+	return 1;
+}
+
+int zmop_get_routes_info_ext(int izmop, int *buffer, int size) {
+	if (izmop < 0 || izmop >= MAX_NUM_ZMOPS) {
+		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", izmop);
+		return -1;
+	}
+	if (size > MAX_NUM_ZMIPS)
+		size = MAX_NUM_ZMIPS;
+	if (size > 0)
+		memcpy((void *)buffer, (void *)zmops[izmop].route_from_zmips, size * sizeof(int));
+	return size > 0 ? size : 0;
+}
+
+int zmop_get_routes_info_all_ext(int *buffer, int size) {
+	if (size < MAX_NUM_ZMOPS * MAX_NUM_ZMIPS)
+		return -1;
+	int iz;
+	for (iz=0; iz<MAX_NUM_ZMOPS; iz++) {
 		memcpy((void *)buffer, (void *)zmops[iz].route_from_zmips, MAX_NUM_ZMIPS * sizeof(int));
 		buffer += MAX_NUM_ZMIPS;
 	}
-	return 1;
+	return MAX_NUM_ZMOPS * MAX_NUM_ZMIPS;
+}
+
+int get_max_num_zmips() {
+	return MAX_NUM_ZMIPS;
+}
+
+int get_max_num_zmops() {
+	return MAX_NUM_ZMOPS;
 }
 
 // Note range & Transpose
 
 int set_global_transpose(int8_t transpose) {
+	router_config_begin();
 	global_transpose = transpose;
+	router_config_commit();
 	return global_transpose;
 }
 
@@ -908,7 +1968,9 @@ int zmop_set_note_low(int iz, uint8_t nlow) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	zmops[iz].note_low = nlow;
+	router_config_commit();
 	return 1;
 }
 
@@ -917,7 +1979,9 @@ int zmop_set_note_high(int iz, uint8_t nhigh) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	zmops[iz].note_high = nhigh;
+	router_config_commit();
 	return 1;
 }
 
@@ -926,7 +1990,9 @@ int zmop_set_transpose_octave(int iz, int8_t trans_oct) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	zmops[iz].transpose_octave = trans_oct;
+	router_config_commit();
 	return 1;
 }
 
@@ -935,7 +2001,9 @@ int zmop_set_transpose_semitone(int iz, int8_t trans_semi) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	zmops[iz].transpose_semitone = trans_semi;
+	router_config_commit();
 	return 1;
 }
 
@@ -976,10 +2044,12 @@ int zmop_set_note_range_transpose(int iz, uint8_t nlow, uint8_t nhigh, int8_t tr
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	zmops[iz].note_low = nlow;
 	zmops[iz].note_high = nhigh;
 	zmops[iz].transpose_octave = trans_oct;
 	zmops[iz].transpose_semitone = trans_semi;
+	router_config_commit();
 	return 1;
 }
 
@@ -988,10 +2058,12 @@ int zmop_reset_note_range_transpose(int iz) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	zmops[iz].note_low = 0;
 	zmops[iz].note_high = 127;
 	zmops[iz].transpose_octave = 0;
 	zmops[iz].transpose_semitone = 0;
+	router_config_commit();
 	return 1;
 }
 
@@ -1002,9 +2074,11 @@ int zmop_reset_cc_route(int iz) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	for (int i = 0; i < 128; i++) {
 		zmops[iz].cc_route[i] = 0;
 	}
+	router_config_commit();
 	return 1;
 }
 
@@ -1013,9 +2087,11 @@ int zmop_set_cc_route(int iz, uint8_t *cc_route) {
 		fprintf(stderr, "ZynMidiRouter: Bad output port index (%d).\n", iz);
 		return 0;
 	}
+	router_config_begin();
 	for (int i = 0; i < 128; i++) {
 		zmops[iz].cc_route[i] = cc_route[i];
 	}
+	router_config_commit();
 	return 1;
 }
 
@@ -1039,6 +2115,8 @@ int init_jack_midi(char *name) {
 		fprintf(stderr, "ZynMidiRouter: Error connecting with jack server.\n");
 		return 0;
 	}
+	router_stats->sample_rate = jack_get_sample_rate(jack_client);
+	router_stats->buffer_size = jack_get_buffer_size(jack_client);
 
 	int i, j;
 	char port_name[12];
@@ -1053,133 +2131,1321 @@ int init_jack_midi(char *name) {
 	if (!zmip_init(ZMIP_CTRL, "ctrl_in", ZMIP_CTRL_FLAGS)) return 0;
 	if (!zmip_init(ZMIP_FAKE_INT, NULL, ZMIP_INT_FLAGS)) return 0;
 	if (!zmip_init(ZMIP_FAKE_UI, NULL, ZMIP_UI_FLAGS)) return 0;
+	router_stats_set_name(router_stats->zmips + ZMIP_FAKE_INT, "internal");
+	router_stats_set_name(router_stats->zmips + ZMIP_FAKE_UI, "ui");
+
+	// Init MIDI Output Ports (ZMOPs)
+	for (i = ZMOP_CH0; i <= ZMOP_CH15; i++) {
+		sprintf(port_name, "ch%d_out", i);
+		if (!zmop_init(ZMOP_CH0 + i, port_name, ZMOP_CHAIN_FLAGS)) return 0;
+		//zmop_set_midi_chan(ZMOP_CH0 + i, i);
+	}
+	if (!zmop_init(ZMOP_MOD, "mod_out", ZMOP_CHAIN_FLAGS)) return 0;
+	zmop_set_midi_chan_all(ZMOP_MOD);
+	if (!zmop_init(ZMOP_STEP, "step_out", FLAG_ZMOP_DROPSYSEX|FLAG_ZMOP_DIRECTOUT)) return 0;
+	zmop_set_midi_chan_all(ZMOP_STEP);
+	if (!zmop_init(ZMOP_CTRL, "ctrl_out", FLAG_ZMOP_DIRECTOUT)) return 0;
+	zmop_set_midi_chan_all(ZMOP_CTRL);
+	for (i = 0; i < NUM_ZMOP_DEVS; i++) {
+		sprintf(port_name, "dev%d_out", i);
+		if (!zmop_init(ZMOP_DEV0 + i, port_name, FLAG_ZMOP_DIRECTOUT)) return 0;
+		zmop_set_midi_chan_all(ZMOP_DEV0 + i);
+	}
+
+	// Route MIDI Input to MIDI Output Ports: ZMIPs => ZMOPs
+	for (i = 0; i < ZMOP_CTRL; i++) {
+		// External Input Devices to all ZMOPS => By default, all chains receive from all devices
+		for (j = 0; j < NUM_ZMIP_DEVS; j++) {
+			if (!zmop_set_route_from(i, ZMIP_DEV0 + j, 1)) return 0;
+		}
+		// MIDI player to all ZMOPS
+		if (!zmop_set_route_from(i, ZMIP_SEQ, 1)) return 0;
+		// Step Sequencer playback (ZMIP_STEP) to all ZMOPS except sequencer capture (ZMOP_STEP)
+		if (i != ZMOP_STEP) {
+			if (!zmop_set_route_from(i, ZMIP_STEP, 1)) return 0;
+		}
+		// Internal MIDI to all ZMOPS
+		if (!zmop_set_route_from(i, ZMIP_FAKE_INT, 1)) return 0;
+		// MIDI from UI to Chain's ZMOPS
+		if (i >= ZMOP_CH0 && i <= ZMOP_MOD) {
+			if (!zmop_set_route_from(i, ZMIP_FAKE_UI, 1)) return 0;
+		}
+	}
+	// ZMIP_CTRL is not routed to any output port, only captured by Zynthian UI
+
+	// Init Jack Process
+	jack_set_port_connect_callback(jack_client, jack_connect_cb, 0);
+	jack_set_process_callback(jack_client, jack_process, 0);
+	jack_set_buffer_size_callback(jack_client, jack_buffer_size_change, 0);
+	if (jack_activate(jack_client)) {
+		fprintf(stderr, "ZynMidiRouter: Error activating jack client.\n");
+		return 0;
+	}
+
+	return 1;
+}
+
+int end_jack_midi() {
+	if (jack_client_close(jack_client)) {
+		fprintf(stderr, "ZynMidiRouter: Error closing jack client.\n");
+	}
+	int i;
+	for (i = 0; i < MAX_NUM_ZMOPS; i++) zmop_end(i);
+	for (i = 0; i < MAX_NUM_ZMIPS; i++) zmip_end(i);
+	return 1;
+}
+
+// Convert ring-buffer record's capture time to frame offset in current cycle
+static inline jack_nframes_t rb_event_time(jack_nframes_t t) {
+	int32_t offset = (int32_t)(t - rb_frame_origin);
+	if (offset < 0)
+		return 0; // Late event => ASAP
+	if (offset > (int32_t)last_frame)
+		return last_frame; // Captured while processing current cycle
+	return offset;
+}
+
+// Copy data to a ring-buffer write vector, starting at pos
+static void rb_vector_write(jack_ringbuffer_data_t *vec, size_t pos, const void *data, size_t n) {
+	const char *src = (const char *)data;
+	while (n > 0) {
+		int i = pos < vec[0].len ? 0 : 1;
+		size_t p = i ? pos - vec[0].len : pos;
+		size_t m = vec[i].len - p;
+		if (m > n)
+			m = n;
+		memcpy(vec[i].buf + p, src, m);
+		pos += m;
+		src += m;
+		n -= m;
+	}
+}
+
+// Copy data from a ring-buffer read vector, starting at pos
+static void rb_vector_read(jack_ringbuffer_data_t *vec, size_t pos, void *data, size_t n) {
+	char *dst = (char *)data;
+	while (n > 0) {
+		int i = pos < vec[0].len ? 0 : 1;
+		size_t p = i ? pos - vec[0].len : pos;
+		size_t m = vec[i].len - p;
+		if (m > n)
+			m = n;
+		memcpy(dst, vec[i].buf + p, m);
+		pos += m;
+		dst += m;
+		n -= m;
+	}
+}
+
+// Get next record from ring-buffer, without consuming it. Event data is read in place,
+// unless it's wrapped around the end of the ring or shorter than 3 bytes, in which case
+// it's copied to buffer (zero-padded to 3 bytes), so buffer[1] & buffer[2] are always valid.
+// Returns the record size, to be released with jack_ringbuffer_read_advance() once the
+// event is processed, or 0 if there is no record (event->time is set to 0xFFFFFFFF).
+size_t populate_midi_event_from_rb(jack_ringbuffer_t *rb, jack_midi_event_t *event, uint8_t *buffer) {
+	jack_ringbuffer_data_t vec[2];
+	struct rb_midi_record_st hdr;
+	event->time = 0xFFFFFFFF;
+	event->size = 0;
+
+	jack_ringbuffer_get_read_vector(rb, vec);
+	size_t len = vec[0].len + vec[1].len;
+	if (len < sizeof(hdr))
+		return 0;
+	rb_vector_read(vec, 0, &hdr, sizeof(hdr));
+	if (hdr.size == 0 || hdr.size > JACK_MIDI_BUFFER_SIZE || sizeof(hdr) + hdr.size > len) {
+		// Records are written at once => this is not an incomplete record but a corrupted ring
+		zynlog(ZYNLOG_RB_BAD_RECORD, hdr.size, 0);
+		jack_ringbuffer_read_advance(rb, len);
+		return 0;
+	}
+
+	size_t pos = sizeof(hdr);
+	if (hdr.size < 3) {
+		buffer[1] = buffer[2] = 0;
+		rb_vector_read(vec, pos, buffer, hdr.size);
+		event->buffer = buffer;
+	} else if (pos + hdr.size <= vec[0].len) {
+		event->buffer = (jack_midi_data_t *)vec[0].buf + pos;
+	} else if (pos >= vec[0].len) {
+		event->buffer = (jack_midi_data_t *)vec[1].buf + pos - vec[0].len;
+	} else {
+		rb_vector_read(vec, pos, buffer, hdr.size);
+		event->buffer = buffer;
+	}
+	event->size = hdr.size;
+	event->time = rb_event_time(hdr.time);
+	return pos + hdr.size;
+}
+
+// Populate zmip event with next event from its input queue / buffer
+// izmip: Index of zmip
+void populate_zmip_event(struct zmip_st * zmip) {
+	if (zmip->jport) {
+		// Jack input buffer used for jack input ports
+		if (zmip->next_event >= zmip->event_count || jack_midi_event_get(&(zmip->event), zmip->buffer, zmip->next_event++) != 0)
+			zmip->event.time = 0xFFFFFFFF; // events with time 0xFFFFFFFF are ignored
+	} else if (zmip->lanes) {
+		// Release the record of the last processed event, that was read in place
+		struct zmip_lane_st * lane = zmip->lane;
+		if (lane) {
+			jack_ringbuffer_read_advance(lane->rbuffer, lane->rb_pending);
+			lane->rb_pending = 0;
+			lane->event.time = 0xFFFFFFFF;
+		}
+		// Merge lanes => get the earliest event
+		zmip->lane = NULL;
+		for (int i = 0; i < NUM_ZMIP_LANES; i++) {
+			lane = zmip->lanes + i;
+			if (lane->event.time == 0xFFFFFFFF)
+				lane->rb_pending = populate_midi_event_from_rb(lane->rbuffer, &lane->event, lane->wrap_buffer);
+			if (lane->event.time != 0xFFFFFFFF && (!zmip->lane || lane->event.time < zmip->lane->event.time))
+				zmip->lane = lane;
+		}
+		// Lanes are sorted by capture time, but times are converted to frame offsets
+		// with clamping => keep queue sorted
+		jack_nframes_t prev_time = zmip->event.time;
+		if (zmip->lane) {
+			zmip->event = zmip->lane->event;
+			if (prev_time != 0xFFFFFFFF && zmip->event.time < prev_time)
+				zmip->event.time = prev_time;
+		} else {
+			zmip->event.time = 0xFFFFFFFF;
+		}
+	}
+}
+
+//-----------------------------------------------------
+// Event scheduler => K-way merge of zmip queues
+//-----------------------------------------------------
+
+// Binary min-heap with the indexes of zmips having a pending event, ordered by
+// event time. Ties are resolved by zmip index, so events with the same time are
+// processed in the same order as a linear scan would do.
+int zmip_heap[MAX_NUM_ZMIPS];
+int zmip_heap_size;
+
+// Return true if zmip a's pending event must be processed before zmip b's one
+static inline int zmip_heap_before(int a, int b) {
+	if (zmips[a].event.time != zmips[b].event.time)
+		return zmips[a].event.time < zmips[b].event.time;
+	return a < b;
+}
+
+void zmip_heap_reset() {
+	zmip_heap_size = 0;
+}
+
+// Add a zmip to the heap. Only zmips with a pending event should be added.
+void zmip_heap_push(int izmip) {
+	int i = zmip_heap_size++;
+	while (i > 0) {
+		int parent = (i - 1) >> 1;
+		if (!zmip_heap_before(izmip, zmip_heap[parent]))
+			break;
+		zmip_heap[i] = zmip_heap[parent];
+		i = parent;
+	}
+	zmip_heap[i] = izmip;
+}
+
+// Restore the heap after the top zmip has advanced to its next event.
+// The top zmip is removed if its queue is exhausted.
+void zmip_heap_update_top() {
+	if (zmip_heap_size == 0)
+		return;
+	int izmip = zmip_heap[0];
+	if (zmips[izmip].event.time == 0xFFFFFFFF) {
+		izmip = zmip_heap[--zmip_heap_size];
+		if (zmip_heap_size == 0)
+			return;
+	}
+	int i = 0;
+	while (1) {
+		int child = 2 * i + 1;
+		if (child >= zmip_heap_size)
+			break;
+		if (child + 1 < zmip_heap_size && zmip_heap_before(zmip_heap[child + 1], zmip_heap[child]))
+			child++;
+		if (!zmip_heap_before(zmip_heap[child], izmip))
+			break;
+		zmip_heap[i] = zmip_heap[child];
+		i = child;
+	}
+	zmip_heap[i] = izmip;
+}
+
+//-----------------------------------------------------------------------------
+// SysEx reassembly
+//-----------------------------------------------------------------------------
+
+int init_sysex_pool() {
+	sysex_pool = calloc(SYSEX_POOL_SIZE, sizeof(struct sysex_buffer_st));
+	if (!sysex_pool) {
+		fprintf(stderr, "ZynMidiRouter: Error allocating SysEx pool.\n");
+		return 0;
+	}
+	// lock the pool into memory, so jack process never faults on it
+	if (mlock(sysex_pool, SYSEX_POOL_SIZE * sizeof(struct sysex_buffer_st))) {
+		fprintf(stderr, "ZynMidiRouter: Error locking memory for SysEx pool.\n");
+		free(sysex_pool);
+		sysex_pool = NULL;
+		return 0;
+	}
+	for (int i = 0; i < SYSEX_POOL_SIZE; i++)
+		sysex_pool_free[i] = sysex_pool + i;
+	sysex_pool_nfree = SYSEX_POOL_SIZE;
+	memset(&router_stats->sysex, 0, sizeof(router_stats->sysex));
+	return 1;
+}
+
+int end_sysex_pool() {
+	if (sysex_pool) {
+		munlock(sysex_pool, SYSEX_POOL_SIZE * sizeof(struct sysex_buffer_st));
+		free(sysex_pool);
+		sysex_pool = NULL;
+	}
+	sysex_pool_nfree = 0;
+	return 1;
+}
+
+struct sysex_buffer_st * sysex_pool_acquire() {
+	if (sysex_pool_nfree == 0)
+		return NULL;
+	struct sysex_buffer_st * sxb = sysex_pool_free[--sysex_pool_nfree];
+	sxb->size = 0;
+	return sxb;
+}
+
+void sysex_pool_release(struct sysex_buffer_st * sxb) {
+	if (sxb && sysex_pool_nfree < SYSEX_POOL_SIZE)
+		sysex_pool_free[sysex_pool_nfree++] = sxb;
+}
+
+// Release reassembly buffer, if any, and go idle
+void zmip_sysex_reset(struct zmip_st * zmip) {
+	sysex_pool_release(zmip->sysex);
+	zmip->sysex = NULL;
+	zmip->sysex_state = SYSEX_IDLE;
+}
+
+// Append event data to zmip's reassembly buffer. Returns 0 if it doesn't fit.
+static inline int zmip_sysex_append(struct zmip_st * zmip, jack_midi_event_t * ev) {
+	if (zmip->sysex->size + ev->size > SYSEX_BUFFER_SIZE)
+		return 0;
+	memcpy(zmip->sysex->data + zmip->sysex->size, ev->buffer, ev->size);
+	zmip->sysex->size += ev->size;
+	return 1;
+}
+
+// Feed an event to the zmip's SysEx reassembly. Complete messages are passed through.
+// When the last chunk of a splitted message arrives, the event is replaced by the
+// reassembled message, so it's routed & captured as a whole. Buffer is released by
+// zmip_sysex_reset() after processing.
+// Returns 1 if the event must be processed, 0 if it was consumed.
+int zmip_sysex_reassemble(struct zmip_st * zmip, jack_midi_event_t * ev) {
+	uint8_t b0 = ev->buffer[0];
+	int end = (ev->buffer[ev->size - 1] == 0xF7);
+
+	// Real-time messages can be interleaved with SysEx data
+	if (b0 >= 0xF8)
+		return 1;
+
+	// Continuation chunk
+	if (b0 < 0x80 || b0 == 0xF7) {
+		switch (zmip->sysex_state) {
+			case SYSEX_RECEIVING:
+				if (!zmip_sysex_append(zmip, ev)) {
+					router_stats->sysex.oversize++;
+					sysex_pool_release(zmip->sysex);
+					zmip->sysex = NULL;
+					zmip->sysex_state = end ? SYSEX_IDLE : SYSEX_SKIPPING;
+					return 0;
+				}
+				if (!end)
+					return 0;
+				router_stats->sysex.completed++;
+				zmip->sysex_state = SYSEX_COMPLETE;
+				ev->buffer = zmip->sysex->data;
+				ev->size = zmip->sysex->size;
+				return 1;
+			case SYSEX_SKIPPING:
+				if (end)
+					zmip->sysex_state = SYSEX_IDLE;
+				return 0;
+			default:
+				// Stray data bytes
+				router_stats->sysex.aborted++;
+				return 0;
+		}
+	}
+
+	// Any other status byte ends an unfinished message
+	if (zmip->sysex_state == SYSEX_RECEIVING)
+		router_stats->sysex.aborted++;
+	if (zmip->sysex_state != SYSEX_IDLE)
+		zmip_sysex_reset(zmip);
+
+	// Start of splitted SysEx
+	if (b0 == SYSTEM_EXCLUSIVE && !end) {
+		zmip->sysex = sysex_pool_acquire();
+		if (!zmip->sysex) {
+			router_stats->sysex.no_buffer++;
+			zmip->sysex_state = SYSEX_SKIPPING;
+		} else if (!zmip_sysex_append(zmip, ev)) {
+			router_stats->sysex.oversize++;
+			zmip_sysex_reset(zmip);
+			zmip->sysex_state = SYSEX_SKIPPING;
+		} else {
+			zmip->sysex_state = SYSEX_RECEIVING;
+		}
+		return 0;
+	}
+	return 1;
+}
+
+uint32_t get_sysex_num_completed() {
+	return router_stats->sysex.completed;
+}
+
+uint32_t get_sysex_num_aborted() {
+	return router_stats->sysex.aborted;
+}
+
+uint32_t get_sysex_num_oversize() {
+	return router_stats->sysex.oversize;
+}
+
+uint32_t get_sysex_num_no_buffer() {
+	return router_stats->sysex.no_buffer;
+}
+
+//-----------------------------------------------------------------------------
+// Router Statistics
+//-----------------------------------------------------------------------------
+
+int init_router_stats() {
+	struct zynmidi_stats_st * stats = NULL;
+	int fd = -1;
+	if (router_stats_shm_name)
+		fd = shm_open(router_stats_shm_name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		if (router_stats_shm_name)
+			fprintf(stderr, "ZynMidiRouter: Error creating shared memory for router statistics.\n");
+	} else {
+		if (ftruncate(fd, sizeof(struct zynmidi_stats_st)) == 0)
+			stats = mmap(NULL, sizeof(struct zynmidi_stats_st), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		close(fd);
+		if (stats == NULL || stats == MAP_FAILED) {
+			fprintf(stderr, "ZynMidiRouter: Error mapping shared memory for router statistics.\n");
+			shm_unlink(router_stats_shm_name);
+			stats = NULL;
+		}
+	}
+	// Statistics are always available for jack process => use private memory as fallback
+	if (stats) {
+		// Lock it in memory, so jack process never page-faults when updating counters
+		router_stats_locked = (mlock(stats, sizeof(struct zynmidi_stats_st)) == 0);
+		if (!router_stats_locked)
+			fprintf(stderr, "ZynMidiRouter: Error locking memory for router statistics.\n");
+		router_stats = stats;
+	} else {
+		router_stats = &router_stats_private;
+	}
+	memset(router_stats, 0, sizeof(struct zynmidi_stats_st));
+	router_stats->num_zmips = MAX_NUM_ZMIPS;
+	router_stats->num_zmops = MAX_NUM_ZMOPS;
+	router_stats->size = sizeof(struct zynmidi_stats_st);
+	__atomic_store_n(&router_stats->version, ZYNMIDI_STATS_VERSION, __ATOMIC_RELEASE);
+	return stats != NULL;
+}
+
+int end_router_stats() {
+	if (router_stats != &router_stats_private) {
+		struct zynmidi_stats_st * stats = router_stats;
+		router_stats = &router_stats_private;
+		munmap(stats, sizeof(struct zynmidi_stats_st));
+		shm_unlink(router_stats_shm_name);
+	}
+	return 1;
+}
+
+void router_stats_set_name(struct zynmidi_port_stats_st * port_stats, const char * name) {
+	if (name)
+		snprintf(port_stats->name, ZYNMIDI_STATS_NAME_SIZE, "%s", name);
+	else
+		port_stats->name[0] = 0;
+}
+
+//-----------------------------------------------------------------------------
+// Jack Process Profiling
+//-----------------------------------------------------------------------------
+
+static inline uint64_t router_profile_now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void router_profile_clear() {
+	memset(router_profile.histograms, 0, sizeof(router_profile.histograms));
+	for (int i = 0; i < ZYNMIDI_PROF_NUM_HISTOGRAMS; i++)
+		router_profile.histograms[i].bucket_width = ZYNMIDI_PROF_TIME_BUCKET_NS;
+	router_profile.histograms[ZYNMIDI_PROF_PERIOD].bucket_width = ZYNMIDI_PROF_PERIOD_BUCKET_NS;
+	router_profile.histograms[ZYNMIDI_PROF_EVENTS].bucket_width = 1;
+	router_profile_last_start = 0;
+}
+
+static inline void router_profile_record(struct zynmidi_histogram_st * h, uint64_t val, uint64_t now_ns, jack_nframes_t frame) {
+	if (val > 0xFFFFFFFF)
+		val = 0xFFFFFFFF;
+	uint32_t ib = val / h->bucket_width;
+	if (ib >= ZYNMIDI_PROF_NUM_BUCKETS)
+		ib = ZYNMIDI_PROF_NUM_BUCKETS - 1;
+	h->buckets[ib]++;
+	h->count++;
+	h->sum += val;
+	if (val > h->max) {
+		h->max = val;
+		h->max_time_us = now_ns / 1000;
+		h->max_frame = frame;
+	}
+}
+
+// Record a profiled cycle. t: start time, end of setup, end of dispatch & end of flush (ns)
+// This is called from jack process!!
+static void router_profile_update(uint64_t * t, uint32_t n_events, jack_nframes_t nframes, jack_nframes_t frame) {
+	// Writer side of seqlock => odd while updating
+	uint32_t seq = router_profile.seq;
+	__atomic_store_n(&router_profile.seq, seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (__atomic_exchange_n(&router_profile_reset, 0, __ATOMIC_ACQUIRE))
+		router_profile_clear();
+	router_profile.sample_rate = router_stats->sample_rate;
+	router_profile.nframes = nframes;
+	if (router_profile.sample_rate)
+		router_profile.period_ns = (uint64_t)nframes * 1000000000 / router_profile.sample_rate;
+
+	struct zynmidi_histogram_st * h = router_profile.histograms;
+	router_profile_record(h + ZYNMIDI_PROF_TOTAL, t[3] - t[0], t[0], frame);
+	router_profile_record(h + ZYNMIDI_PROF_SETUP, t[1] - t[0], t[0], frame);
+	router_profile_record(h + ZYNMIDI_PROF_DISPATCH, t[2] - t[1], t[0], frame);
+	router_profile_record(h + ZYNMIDI_PROF_FLUSH, t[3] - t[2], t[0], frame);
+	if (router_profile_last_start)
+		router_profile_record(h + ZYNMIDI_PROF_PERIOD, t[0] - router_profile_last_start, t[0], frame);
+	router_profile_last_start = t[0];
+	router_profile_record(h + ZYNMIDI_PROF_EVENTS, n_events, t[0], frame);
+
+	__atomic_store_n(&router_profile.seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+void init_router_profile() {
+	router_profiling = 0;
+	router_profile_reset = 0;
+	router_profile.seq = 0;
+	router_profile_clear();
+}
+
+void set_router_profiling(int enable) {
+	if (enable)
+		reset_router_profile();
+	__atomic_store_n(&router_profiling, enable ? 1 : 0, __ATOMIC_RELEASE);
+}
+
+int get_router_profiling() {
+	return router_profiling;
+}
+
+void reset_router_profile() {
+	__atomic_store_n(&router_profile_reset, 1, __ATOMIC_RELEASE);
+}
+
+int get_router_profile(struct zynmidi_profile_st * profile) {
+	// Reader side of seqlock => retry while jack process is updating
+	for (int i = 0; i < 1000; i++) {
+		uint32_t seq = __atomic_load_n(&router_profile.seq, __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			sched_yield();
+			continue;
+		}
+		memcpy(profile, &router_profile, sizeof(struct zynmidi_profile_st));
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&router_profile.seq, __ATOMIC_RELAXED) == seq)
+			return 1;
+	}
+	return 0;
+}
+
+static struct zynmidi_histogram_st * get_router_profile_histogram_st(int ih, struct zynmidi_profile_st * profile) {
+	if (ih < 0 || ih >= ZYNMIDI_PROF_NUM_HISTOGRAMS) {
+		fprintf(stderr, "ZynMidiRouter: Bad profile histogram index (%d).\n", ih);
+		return NULL;
+	}
+	if (!get_router_profile(profile))
+		return NULL;
+	return profile->histograms + ih;
+}
+
+int get_router_profile_histogram(int ih, uint32_t * buckets, int n) {
+	struct zynmidi_profile_st profile;
+	struct zynmidi_histogram_st * h = get_router_profile_histogram_st(ih, &profile);
+	if (!h)
+		return 0;
+	if (n > ZYNMIDI_PROF_NUM_BUCKETS)
+		n = ZYNMIDI_PROF_NUM_BUCKETS;
+	memcpy(buckets, h->buckets, n * sizeof(uint32_t));
+	return n;
+}
+
+uint32_t get_router_profile_bucket_width(int ih) {
+	struct zynmidi_profile_st profile;
+	struct zynmidi_histogram_st * h = get_router_profile_histogram_st(ih, &profile);
+	return h ? h->bucket_width : 0;
+}
+
+uint32_t get_router_profile_count(int ih) {
+	struct zynmidi_profile_st profile;
+	struct zynmidi_histogram_st * h = get_router_profile_histogram_st(ih, &profile);
+	return h ? h->count : 0;
+}
+
+double get_router_profile_avg(int ih) {
+	struct zynmidi_profile_st profile;
+	struct zynmidi_histogram_st * h = get_router_profile_histogram_st(ih, &profile);
+	if (!h || h->count == 0)
+		return 0.0;
+	return (double)h->sum / h->count;
+}
+
+uint32_t get_router_profile_max(int ih) {
+	struct zynmidi_profile_st profile;
+	struct zynmidi_histogram_st * h = get_router_profile_histogram_st(ih, &profile);
+	return h ? h->max : 0;
+}
+
+uint64_t get_router_profile_max_time(int ih) {
+	struct zynmidi_profile_st profile;
+	struct zynmidi_histogram_st * h = get_router_profile_histogram_st(ih, &profile);
+	return h ? h->max_time_us : 0;
+}
+
+uint32_t get_router_profile_period() {
+	return router_profile.period_ns;
+}
+
+//-----------------------------------------------------------------------------
+// RT Memory
+//-----------------------------------------------------------------------------
+// Memory used by jack process is registered as regions. Static & init-time regions are
+// registered by init_router_rt_memory, buffers allocated later when created. If RT memory
+// mode is enabled, regions are locked & prefaulted when registered, or all at once when
+// the mode is enabled later.
+
+// Write access to every page, so zero pages & copy-on-write are resolved now, not by jack process.
+// Atomic no-op, as jack process could be using the region.
+static void router_rt_memory_prefault(void * addr, size_t size) {
+	long page_size = sysconf(_SC_PAGESIZE);
+	uint8_t * p = (uint8_t *)addr;
+	for (size_t i = 0; i < size; i += page_size)
+		__atomic_fetch_or(p + i, 0, __ATOMIC_RELAXED);
+	if (size)
+		__atomic_fetch_or(p + size - 1, 0, __ATOMIC_RELAXED);
+}
+
+// Called with router_rt_memory_mutex held
+static void router_rt_memory_lock(struct zynmidi_rt_region_st * region) {
+	if (region->locked)
+		return;
+	if (mlock(region->addr, region->size) == 0)
+		region->locked = 1;
+	else
+		fprintf(stderr, "ZynMidiRouter: Can't lock RT memory region '%s' (%zu bytes). Check RLIMIT_MEMLOCK.\n", region->name, region->size);
+	// Prefault anyway => if not locked, at least it's resident until swapped
+	router_rt_memory_prefault(region->addr, region->size);
+}
+
+// Page is covered by another locked region. Called with router_rt_memory_mutex held.
+static int router_rt_memory_page_shared(struct zynmidi_rt_region_st * region, uintptr_t page, long page_size) {
+	for (int i = 0; i < router_rt_n_regions; i++) {
+		struct zynmidi_rt_region_st * other = router_rt_regions + i;
+		if (other == region || !other->locked)
+			continue;
+		uintptr_t first = (uintptr_t)other->addr & ~(uintptr_t)(page_size - 1);
+		if (page >= first && page < (uintptr_t)other->addr + other->size)
+			return 1;
+	}
+	return 0;
+}
+
+// Regions locked by their owner are kept locked. Locks work on whole pages & don't nest =>
+// pages shared with other locked regions are kept locked, and nothing is unlocked while the
+// whole process is locked.
+static void router_rt_memory_unlock(struct zynmidi_rt_region_st * region) {
+	if (!region->locked || region->always_locked)
+		return;
+	region->locked = 0;
+	if (router_rt_memory_all)
+		return;
+	long page_size = sysconf(_SC_PAGESIZE);
+	uintptr_t end = (uintptr_t)region->addr + region->size;
+	uintptr_t page = (uintptr_t)region->addr & ~(uintptr_t)(page_size - 1);
+	uintptr_t run = 0;
+	for (; page < end; page += page_size) {
+		if (router_rt_memory_page_shared(region, page, page_size)) {
+			if (run)
+				munlock((void *)run, page - run);
+			run = 0;
+		} else if (!run) {
+			run = page;
+		}
+	}
+	if (run)
+		munlock((void *)run, page - run);
+}
+
+// After munlockall, lock again the regions locked by their owner. Called with router_rt_memory_mutex held.
+static void router_rt_memory_relock_owned() {
+	for (int i = 0; i < router_rt_n_regions; i++) {
+		struct zynmidi_rt_region_st * region = router_rt_regions + i;
+		if (region->always_locked && mlock(region->addr, region->size))
+			fprintf(stderr, "ZynMidiRouter: Can't lock RT memory region '%s' (%zu bytes) again.\n", region->name, region->size);
+	}
+}
+
+// Process locked memory, in bytes (VmLck). -1 if unknown.
+static long router_rt_memory_process_locked() {
+	FILE * file = fopen("/proc/self/status", "r");
+	if (!file)
+		return -1;
+	char line[128];
+	long size = -1;
+	while (fgets(line, sizeof(line), file)) {
+		if (strncmp(line, "VmLck:", 6) == 0) {
+			size = atol(line + 6) * 1024;
+			break;
+		}
+	}
+	fclose(file);
+	return size;
+}
+
+// Bytes locked through registered regions, counting shared pages once. Called with router_rt_memory_mutex held.
+static long router_rt_memory_regions_locked() {
+	long page_size = sysconf(_SC_PAGESIZE);
+	long size = 0;
+	for (int i = 0; i < router_rt_n_regions; i++) {
+		struct zynmidi_rt_region_st * region = router_rt_regions + i;
+		if (!region->locked)
+			continue;
+		uintptr_t end = (uintptr_t)region->addr + region->size;
+		for (uintptr_t page = (uintptr_t)region->addr & ~(uintptr_t)(page_size - 1); page < end; page += page_size) {
+			int j;
+			for (j = 0; j < i; j++) {
+				struct zynmidi_rt_region_st * other = router_rt_regions + j;
+				uintptr_t first = (uintptr_t)other->addr & ~(uintptr_t)(page_size - 1);
+				if (other->locked && page >= first && page < (uintptr_t)other->addr + other->size)
+					break;
+			}
+			if (j == i)
+				size += page_size;
+		}
+	}
+	return size;
+}
+
+// Lock/unlock all regions & the whole process, according to mode. munlockall is only called
+// if our mlockall was the first lock of the process: if something else had locked memory,
+// the process stays locked when leaving LOCKALL mode. Called with router_rt_memory_mutex held.
+static void router_rt_memory_apply() {
+	for (int i = 0; i < router_rt_n_regions; i++) {
+		if (router_rt_memory)
+			router_rt_memory_lock(router_rt_regions + i);
+		else
+			router_rt_memory_unlock(router_rt_regions + i);
+	}
+	if (router_rt_memory == ZYNMIDI_RT_MEMORY_LOCKALL && !router_rt_memory_all) {
+		long process_locked = router_rt_memory_process_locked();
+		if (mlockall(MCL_CURRENT | MCL_FUTURE) == 0) {
+			router_rt_memory_all = 1;
+			router_rt_memory_all_owned = process_locked >= 0 && process_locked <= router_rt_memory_regions_locked();
+		} else {
+			fprintf(stderr, "ZynMidiRouter: Can't lock process memory (mlockall). Check RLIMIT_MEMLOCK.\n");
+		}
+	} else if (router_rt_memory != ZYNMIDI_RT_MEMORY_LOCKALL && router_rt_memory_all && router_rt_memory_all_owned) {
+		munlockall();
+		router_rt_memory_all = 0;
+		// munlockall unlocked the regions too
+		router_rt_memory_relock_owned();
+		for (int i = 0; i < router_rt_n_regions; i++) {
+			if (router_rt_regions[i].always_locked)
+				continue;
+			router_rt_regions[i].locked = 0;
+			if (router_rt_memory)
+				router_rt_memory_lock(router_rt_regions + i);
+		}
+	}
+}
+
+static void router_rt_memory_register(const char * name, void * addr, size_t size, int always_locked) {
+	if (!addr || !size)
+		return;
+	pthread_mutex_lock(&router_rt_memory_mutex);
+	if (router_rt_n_regions < ZYNMIDI_RT_MEMORY_MAX_REGIONS) {
+		struct zynmidi_rt_region_st * region = router_rt_regions + router_rt_n_regions++;
+		region->name = name;
+		region->addr = addr;
+		region->size = size;
+		region->locked = always_locked;
+		region->always_locked = always_locked;
+		if (router_rt_memory)
+			router_rt_memory_lock(region);
+	} else {
+		fprintf(stderr, "ZynMidiRouter: Too many RT memory regions. Region '%s' not registered.\n", name);
+	}
+	pthread_mutex_unlock(&router_rt_memory_mutex);
+}
+
+void router_rt_memory_add(const char * name, void * addr, size_t size) {
+	router_rt_memory_register(name, addr, size, 0);
+}
+
+// Register a region locked by its owner (ring-buffers, SysEx pool, etc.) => only reported
+void router_rt_memory_add_locked(const char * name, void * addr, size_t size) {
+	router_rt_memory_register(name, addr, size, 1);
+}
+
+void router_rt_memory_remove(void * addr) {
+	pthread_mutex_lock(&router_rt_memory_mutex);
+	for (int i = 0; i < router_rt_n_regions; i++) {
+		if (router_rt_regions[i].addr == addr) {
+			router_rt_memory_unlock(router_rt_regions + i);
+			router_rt_regions[i] = router_rt_regions[--router_rt_n_regions];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&router_rt_memory_mutex);
+}
+
+void init_router_rt_memory() {
+	router_rt_memory_add("zmips", zmips, sizeof(zmips));
+	router_rt_memory_add("zmops", zmops, sizeof(zmops));
+	router_rt_memory_add("config snapshots", router_config_slots, sizeof(router_config_slots));
+	for (int i = 0; i < MAX_NUM_MIDI_FILTERS; i++)
+		router_rt_memory_add("MIDI filter rules", midi_filters[i].rules_slots, sizeof(midi_filters[i].rules_slots));
+	router_rt_memory_add("direct output wrap buffer", rb_wrap_buffer, sizeof(rb_wrap_buffer));
+	router_rt_memory_add("log ring", zynlog_ring, sizeof(zynlog_ring));
+	router_rt_memory_add("profile", &router_profile, sizeof(router_profile));
+	if (router_stats_locked)
+		router_rt_memory_add_locked("statistics", router_stats, sizeof(struct zynmidi_stats_st));
+	else
+		router_rt_memory_add("statistics", router_stats, sizeof(struct zynmidi_stats_st));
+	router_rt_memory_add_locked("SysEx pool", sysex_pool, SYSEX_POOL_SIZE * sizeof(struct sysex_buffer_st));
+	router_rt_memory_add_locked("UI ring-buffer", zynmidi_buffer->buf, zynmidi_buffer->size);
+	router_rt_memory_add_locked("UI records ring-buffer", zynmidi_record_buffer->buf, zynmidi_record_buffer->size);
+	router_rt_memory_add_locked("UI internal ring-buffer", zynmidi_internal_buffer->buf, zynmidi_internal_buffer->size);
+	pthread_mutex_lock(&router_rt_memory_mutex);
+	router_rt_memory_ready = 1;
+	if (router_rt_memory == ZYNMIDI_RT_MEMORY_LOCKALL)
+		router_rt_memory_apply();
+	pthread_mutex_unlock(&router_rt_memory_mutex);
+}
+
+void end_router_rt_memory() {
+	pthread_mutex_lock(&router_rt_memory_mutex);
+	for (int i = 0; i < router_rt_n_regions; i++)
+		router_rt_memory_unlock(router_rt_regions + i);
+	if (router_rt_memory_all && router_rt_memory_all_owned) {
+		munlockall();
+		router_rt_memory_relock_owned();
+	}
+	router_rt_memory_all = 0;
+	router_rt_memory_all_owned = 0;
+	router_rt_n_regions = 0;
+	router_rt_memory_ready = 0;
+	pthread_mutex_unlock(&router_rt_memory_mutex);
+}
+
+int set_router_rt_memory(int mode) {
+	if (mode < ZYNMIDI_RT_MEMORY_OFF || mode > ZYNMIDI_RT_MEMORY_LOCKALL) {
+		fprintf(stderr, "ZynMidiRouter: Bad RT memory mode (%d).\n", mode);
+		return 0;
+	}
+	pthread_mutex_lock(&router_rt_memory_mutex);
+	router_rt_memory = mode;
+	if (router_rt_memory_ready)
+		router_rt_memory_apply();
+	pthread_mutex_unlock(&router_rt_memory_mutex);
+	return 1;
+}
+
+int get_router_rt_memory() {
+	return router_rt_memory;
+}
+
+size_t get_router_rt_memory_locked() {
+	size_t size = 0;
+	pthread_mutex_lock(&router_rt_memory_mutex);
+	for (int i = 0; i < router_rt_n_regions; i++) {
+		if (router_rt_regions[i].locked)
+			size += router_rt_regions[i].size;
+	}
+	pthread_mutex_unlock(&router_rt_memory_mutex);
+	return size;
+}
+
+// Report regions grouped by name
+void router_rt_memory_report() {
+	size_t locked = 0;
+	size_t total = 0;
+	pthread_mutex_lock(&router_rt_memory_mutex);
+	for (int i = 0; i < router_rt_n_regions; i++) {
+		struct zynmidi_rt_region_st * region = router_rt_regions + i;
+		total += region->size;
+		if (region->locked)
+			locked += region->size;
+		int j;
+		for (j = 0; j < i; j++) {
+			if (strcmp(router_rt_regions[j].name, region->name) == 0)
+				break;
+		}
+		if (j < i)
+			continue;
+		int n = 0;
+		size_t size = 0;
+		size_t size_locked = 0;
+		for (j = i; j < router_rt_n_regions; j++) {
+			if (strcmp(router_rt_regions[j].name, region->name) == 0) {
+				n++;
+				size += router_rt_regions[j].size;
+				if (router_rt_regions[j].locked)
+					size_locked += router_rt_regions[j].size;
+			}
+		}
+		fprintf(stderr, "ZynMidiRouter: RT memory => %-28s x%-3d %9zu bytes, %s\n", region->name, n, size,
+			size_locked == size ? "locked" : (size_locked ? "PARTIALLY LOCKED" : "NOT LOCKED"));
+	}
+	fprintf(stderr, "ZynMidiRouter: RT memory => %zu of %zu bytes locked in %d regions%s\n", locked, total, router_rt_n_regions,
+		router_rt_memory_all ? (router_rt_memory_all_owned ? ", whole process locked (mlockall)" : ", whole process locked (mlockall, kept: memory was locked by others)") : "");
+	pthread_mutex_unlock(&router_rt_memory_mutex);
+}
+
+//-----------------------------------------------------------------------------
+// MIDI Trace Capture
+//-----------------------------------------------------------------------------
+
+// Add a record to the trace ring-buffer. Called from jack process only!
+void router_trace_write_rt(uint8_t type, uint8_t izmip, uint32_t time, const void * data, size_t size) {
+	struct zynmidi_trace_record_st rec;
+	if (size > 0xFFFF || jack_ringbuffer_write_space(router_trace_rb) < sizeof(rec) + size) {
+		__atomic_fetch_add(&router_trace_lost, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	rec.time = time;
+	rec.size = size;
+	rec.type = type;
+	rec.izmip = izmip;
+	jack_ringbuffer_write(router_trace_rb, (const char *)&rec, sizeof(rec));
+	if (size)
+		jack_ringbuffer_write(router_trace_rb, (const char *)data, size);
+}
+
+// Record runtime state at trace start => held notes of each zmop. Called from jack process only!
+static void router_trace_write_state_rt() {
+	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+		if (zmops[izmop].note_chans)
+			router_trace_write_rt(ZYNMIDI_TRACE_NOTES, izmop, 0, zmops[izmop].note_bits, sizeof(zmops[izmop].note_bits));
+	}
+}
 
-	// Init MIDI Output Ports (ZMOPs)
-	for (i = ZMOP_CH0; i <= ZMOP_CH15; i++) {
-		sprintf(port_name, "ch%d_out", i);
-		if (!zmop_init(ZMOP_CH0 + i, port_name, ZMOP_CHAIN_FLAGS)) return 0;
-		//zmop_set_midi_chan(ZMOP_CH0 + i, i);
+// Write a record to the trace file. Called with router_trace_mutex held.
+static void router_trace_write_file(uint8_t type, uint8_t izmip, uint32_t time, const void * data, size_t size) {
+	struct zynmidi_trace_record_st rec;
+	rec.time = time;
+	rec.size = size;
+	rec.type = type;
+	rec.izmip = izmip;
+	fwrite(&rec, sizeof(rec), 1, router_trace_file);
+	if (size)
+		fwrite(data, size, 1, router_trace_file);
+}
+
+// Record writer side configuration. Called from publish_router_config, with router_config_mutex held.
+uint32_t router_trace_write_config(uint32_t filters_changed) {
+	struct zynmidi_trace_config_st tcfg;
+	memset(&tcfg, 0, sizeof(tcfg));
+	tcfg.active_chain = active_chain;
+	tcfg.active_midi_chan = active_midi_chan;
+	tcfg.tuning_pitchbend = tuning_pitchbend;
+	tcfg.midi_master_chan = midi_master_chan;
+	tcfg.midi_system_events = midi_system_events;
+	tcfg.midi_learning_mode = midi_learning_mode;
+	tcfg.zynmidi_mode = zynmidi_mode;
+	tcfg.global_transpose = global_transpose;
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		tcfg.zmip_flags[izmip] = zmips[izmip].flags;
+		tcfg.zmip_connections[izmip] = zmips[izmip].n_connections;
+		tcfg.zmip_midi_filter[izmip] = zmips[izmip].midi_filter;
 	}
-	if (!zmop_init(ZMOP_MOD, "mod_out", ZMOP_CHAIN_FLAGS)) return 0;
-	zmop_set_midi_chan_all(ZMOP_MOD);
-	if (!zmop_init(ZMOP_STEP, "step_out", FLAG_ZMOP_DROPSYSEX|FLAG_ZMOP_DIRECTOUT)) return 0;
-	zmop_set_midi_chan_all(ZMOP_STEP);
-	if (!zmop_init(ZMOP_CTRL, "ctrl_out", FLAG_ZMOP_DIRECTOUT)) return 0;
-	zmop_set_midi_chan_all(ZMOP_CTRL);
-	for (i = 0; i < NUM_ZMOP_DEVS; i++) {
-		sprintf(port_name, "dev%d_out", i);
-		if (!zmop_init(ZMOP_DEV0 + i, port_name, FLAG_ZMOP_DIRECTOUT)) return 0;
-		zmop_set_midi_chan_all(ZMOP_DEV0 + i);
+	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+		struct zmop_st * zmop = zmops + izmop;
+		struct zynmidi_trace_zmop_config_st * zmop_tcfg = tcfg.zmops + izmop;
+		zmop_tcfg->flags = zmop->flags;
+		zmop_tcfg->midi_chan = zmop->midi_chan;
+		for (int i = 0; i < 16; i++)
+			zmop_tcfg->midi_chans[i] = zmop->midi_chans[i];
+		for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++)
+			zmop_tcfg->route_from_zmips[izmip] = zmop->route_from_zmips[izmip] ? 1 : 0;
+		memcpy(zmop_tcfg->cc_route, zmop->cc_route, sizeof(zmop_tcfg->cc_route));
+		zmop_tcfg->note_low = zmop->note_low;
+		zmop_tcfg->note_high = zmop->note_high;
+		zmop_tcfg->transpose_octave = zmop->transpose_octave;
+		zmop_tcfg->transpose_semitone = zmop->transpose_semitone;
+		zmop_tcfg->n_connections = zmop->n_connections;
 	}
 
-	// Route MIDI Input to MIDI Output Ports: ZMIPs => ZMOPs
-	for (i = 0; i < ZMOP_CTRL; i++) {
-		// External Input Devices to all ZMOPS => By default, all chains receive from all devices
-		for (j = 0; j < NUM_ZMIP_DEVS; j++) {
-			if (!zmop_set_route_from(i, ZMIP_DEV0 + j, 1)) return 0;
-		}
-		// MIDI player to all ZMOPS
-		if (!zmop_set_route_from(i, ZMIP_SEQ, 1)) return 0;
-		// Step Sequencer playback (ZMIP_STEP) to all ZMOPS except sequencer capture (ZMOP_STEP)
-		if (i != ZMOP_STEP) {
-			if (!zmop_set_route_from(i, ZMIP_STEP, 1)) return 0;
-		}
-		// Internal MIDI to all ZMOPS
-		if (!zmop_set_route_from(i, ZMIP_FAKE_INT, 1)) return 0;
-		// MIDI from UI to Chain's ZMOPS
-		if (i >= ZMOP_CH0 && i <= ZMOP_MOD) {
-			if (!zmop_set_route_from(i, ZMIP_FAKE_UI, 1)) return 0;
+	pthread_mutex_lock(&router_trace_mutex);
+	uint32_t seq = ++router_trace_cfg_seq;
+	if (router_trace_file) {
+		// MIDI filters are big => record them only if they changed
+		for (int ifilter = 0; ifilter < MAX_NUM_MIDI_FILTERS; ifilter++) {
+			if (ifilter != MIDI_FILTER_GLOBAL && midi_filters[ifilter].refs == 0)
+				continue;
+			if (!(filters_changed & (1 << ifilter)) && !router_trace_need_filter)
+				continue;
+			midi_filter_t * filter = &midi_filters[ifilter].filter;
+			for (int i = 0; i < 8; i++)
+				router_trace_write_file(ZYNMIDI_TRACE_FILTER, ifilter * 8 + i, seq, filter->event_map[i], sizeof(filter->event_map[i]));
 		}
+		router_trace_need_filter = 0;
+		router_trace_write_file(ZYNMIDI_TRACE_CONFIG, 0, seq, &tcfg, sizeof(tcfg));
 	}
-	// ZMIP_CTRL is not routed to any output port, only captured by Zynthian UI
+	pthread_mutex_unlock(&router_trace_mutex);
+	return seq;
+}
+
+// Move jack process records from ring-buffer to file
+static void router_trace_flush() {
+	pthread_mutex_lock(&router_trace_mutex);
+	jack_ringbuffer_data_t vec[2];
+	jack_ringbuffer_get_read_vector(router_trace_rb, vec);
+	for (int i = 0; i < 2; i++) {
+		if (vec[i].len)
+			fwrite(vec[i].buf, vec[i].len, 1, router_trace_file);
+	}
+	jack_ringbuffer_read_advance(router_trace_rb, vec[0].len + vec[1].len);
+	uint32_t lost = __atomic_load_n(&router_trace_lost, __ATOMIC_RELAXED);
+	if (lost != router_trace_lost_written) {
+		router_trace_write_file(ZYNMIDI_TRACE_LOST, 0, lost - router_trace_lost_written, NULL, 0);
+		router_trace_lost_written = lost;
+	}
+	pthread_mutex_unlock(&router_trace_mutex);
+}
 
-	// Init Jack Process
-	jack_set_port_connect_callback(jack_client, jack_connect_cb, 0);
-	jack_set_process_callback(jack_client, jack_process, 0);
-	jack_set_buffer_size_callback(jack_client, jack_buffer_size_change, 0);
-	if (jack_activate(jack_client)) {
-		fprintf(stderr, "ZynMidiRouter: Error activating jack client.\n");
+void * router_trace_thread(void * arg) {
+	while (__atomic_load_n(&router_trace_running, __ATOMIC_ACQUIRE)) {
+		router_trace_flush();
+		usleep(ZYNMIDI_TRACE_POLL_US);
+	}
+	return NULL;
+}
+
+int start_router_trace(const char * fpath) {
+	if (router_trace_file) {
+		fprintf(stderr, "ZynMidiRouter: MIDI trace already running.\n");
+		return 0;
+	}
+	FILE * file = fopen(fpath, "wb");
+	if (!file) {
+		fprintf(stderr, "ZynMidiRouter: Can't open MIDI trace file '%s'.\n", fpath);
+		return 0;
+	}
+	struct zynmidi_trace_header_st header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, ZYNMIDI_TRACE_MAGIC, 4);
+	header.version = ZYNMIDI_TRACE_VERSION;
+	header.sample_rate = router_stats->sample_rate;
+	header.buffer_size = router_stats->buffer_size;
+	header.num_zmips = MAX_NUM_ZMIPS;
+	header.num_zmops = MAX_NUM_ZMOPS;
+	header.config_size = sizeof(struct zynmidi_trace_config_st);
+	fwrite(&header, sizeof(header), 1, file);
+
+	router_trace_rb = jack_ringbuffer_create(ZYNMIDI_TRACE_RB_SIZE);
+	if (!router_trace_rb) {
+		fprintf(stderr, "ZynMidiRouter: Error creating MIDI trace ring-buffer.\n");
+		fclose(file);
+		return 0;
+	}
+	if (jack_ringbuffer_mlock(router_trace_rb)) {
+		fprintf(stderr, "ZynMidiRouter: Error locking memory for MIDI trace ring-buffer.\n");
+		router_rt_memory_add("MIDI trace ring-buffer", router_trace_rb->buf, router_trace_rb->size);
+	} else {
+		router_rt_memory_add_locked("MIDI trace ring-buffer", router_trace_rb->buf, router_trace_rb->size);
+	}
+	router_trace_lost = 0;
+	router_trace_lost_written = 0;
+
+	pthread_mutex_lock(&router_trace_mutex);
+	router_trace_file = file;
+	router_trace_cfg_seq = 0;
+	router_trace_need_filter = 1;
+	pthread_mutex_unlock(&router_trace_mutex);
+
+	// Low priority thread => don't inherit RT scheduling from caller
+	pthread_attr_t attr;
+	struct sched_param param;
+	pthread_attr_init(&attr);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_OTHER);
+	param.sched_priority = 0;
+	pthread_attr_setschedparam(&attr, &param);
+	__atomic_store_n(&router_trace_running, 1, __ATOMIC_RELEASE);
+	int err = pthread_create(&router_trace_tid, &attr, &router_trace_thread, NULL);
+	pthread_attr_destroy(&attr);
+	if (err != 0) {
+		fprintf(stderr, "ZynMidiRouter: Can't create MIDI trace thread :[%s]\n", strerror(err));
+		router_trace_running = 0;
+		pthread_mutex_lock(&router_trace_mutex);
+		router_trace_file = NULL;
+		pthread_mutex_unlock(&router_trace_mutex);
+		fclose(file);
+		router_rt_memory_remove(router_trace_rb->buf);
+		jack_ringbuffer_free(router_trace_rb);
+		router_trace_rb = NULL;
 		return 0;
 	}
 
+	// Publish a snapshot with the full configuration => jack process starts recording when it's applied
+	__atomic_store_n(&router_trace_active, 1, __ATOMIC_RELEASE);
+	router_config_begin();
+	router_config_commit();
 	return 1;
 }
 
-int end_jack_midi() {
-	if (jack_client_close(jack_client)) {
-		fprintf(stderr, "ZynMidiRouter: Error closing jack client.\n");
+int stop_router_trace() {
+	if (!router_trace_file)
+		return 0;
+	__atomic_store_n(&router_trace_active, 0, __ATOMIC_RELEASE);
+	// Wait until jack process has seen it, so it doesn't write to ring-buffer anymore
+	int synced = router_config_sync();
+
+	__atomic_store_n(&router_trace_running, 0, __ATOMIC_RELEASE);
+	pthread_join(router_trace_tid, NULL);
+	router_trace_flush();
+
+	pthread_mutex_lock(&router_trace_mutex);
+	fclose(router_trace_file);
+	router_trace_file = NULL;
+	pthread_mutex_unlock(&router_trace_mutex);
+	if (synced) {
+		router_rt_memory_remove(router_trace_rb->buf);
+		jack_ringbuffer_free(router_trace_rb);
+	} else {
+		// Jack process could be stalled in the middle of a write => leak the ring-buffer
+		fprintf(stderr, "ZynMidiRouter: Jack process not running, MIDI trace ring-buffer not released.\n");
 	}
-	int i;
-	for (i = 0; i < MAX_NUM_ZMOPS; i++) zmop_end(i);
-	for (i = 0; i < MAX_NUM_ZMIPS; i++) zmip_end(i);
+	router_trace_rb = NULL;
+	if (router_trace_lost)
+		fprintf(stderr, "ZynMidiRouter: MIDI trace lost %u records!\n", router_trace_lost);
 	return 1;
 }
 
-// Pop a MIDI event from a ring-buffer
-// rb: pointer to the ring buffer to read from
-// event: pointer to the event struct to populate
-void populate_midi_event_from_rb(jack_ringbuffer_t *rb, jack_midi_event_t *event) {
-	event->size = 3;
-	event->time = 0xFFFFFFFF;	// Ignore message if it's not complete
-	event->buffer = event_buffer;
-	if (jack_ringbuffer_read_space(rb) >= 3) {
-		jack_ringbuffer_read(rb, event->buffer, 3);
-		// Manage SysEx events
-		if (event->buffer[0] == 0xF0) {
-			while (jack_ringbuffer_read_space(rb) >= 1) {
-				jack_ringbuffer_read(rb, event->buffer + event->size++, 1);
-				// SysEx completed => Messages can't be fragmented across buffers!
-				if (event->buffer[event->size - 1] == 0xF7) {
-					event->time = last_frame;
-					break;
-				}
-			}
-		} else {
-			// Put internal events at start of buffer (it is arbitrary so beginning is as good as anywhere)
-			event->time = last_frame;
-		}
-	}
+int get_router_trace_status() {
+	return __atomic_load_n(&router_trace_active, __ATOMIC_ACQUIRE);
 }
 
-// Populate zmip event with next event from its input queue / buffer
-// izmip: Index of zmip
-void populate_zmip_event(struct zmip_st * zmip) {
-	if (zmip->jport) {
-		// Jack input buffer used for jack input ports
-		if (zmip->next_event >= zmip->event_count || jack_midi_event_get(&(zmip->event), zmip->buffer, zmip->next_event++) != 0)
-			zmip->event.time = 0xFFFFFFFF; // events with time 0xFFFFFFFF are ignored
-	} else if ((zmip->flags & FLAG_ZMIP_DIRECTIN) && zmip->rbuffer!=NULL) {
-		populate_midi_event_from_rb(zmip->rbuffer, &zmip->event); //!@todo Is it always okay to put these at the end of the frame?
+uint32_t get_router_trace_lost() {
+	return __atomic_load_n(&router_trace_lost, __ATOMIC_RELAXED);
+}
+
+int router_trace_load_config(struct zynmidi_trace_config_st * tcfg, midi_filter_t ** filters) {
+	router_config_begin();
+	active_chain = tcfg->active_chain;
+	active_midi_chan = tcfg->active_midi_chan;
+	tuning_pitchbend = tcfg->tuning_pitchbend;
+	midi_master_chan = tcfg->midi_master_chan;
+	midi_system_events = tcfg->midi_system_events;
+	midi_learning_mode = tcfg->midi_learning_mode;
+	zynmidi_mode = tcfg->zynmidi_mode;
+	global_transpose = tcfg->global_transpose;
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		zmips[izmip].flags = tcfg->zmip_flags[izmip];
+		zmips[izmip].n_connections = tcfg->zmip_connections[izmip];
+	}
+	// MIDI filters => same indexes than recorded
+	for (int ifilter = 0; ifilter < MAX_NUM_MIDI_FILTERS; ifilter++) {
+		midi_filters[ifilter].refs = 0;
+		if (filters[ifilter]) {
+			memcpy(&midi_filters[ifilter].filter, filters[ifilter], sizeof(midi_filter_t));
+			midi_filters[ifilter].dirty = 1;
+		}
+	}
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		int ifilter = tcfg->zmip_midi_filter[izmip] < MAX_NUM_MIDI_FILTERS ? tcfg->zmip_midi_filter[izmip] : MIDI_FILTER_GLOBAL;
+		zmips[izmip].midi_filter = ifilter;
+		if (ifilter != MIDI_FILTER_GLOBAL)
+			midi_filters[ifilter].refs++;
 	}
+	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+		struct zmop_st * zmop = zmops + izmop;
+		struct zynmidi_trace_zmop_config_st * zmop_tcfg = tcfg->zmops + izmop;
+		zmop->flags = zmop_tcfg->flags;
+		zmop->midi_chan = zmop_tcfg->midi_chan;
+		for (int i = 0; i < 16; i++)
+			zmop->midi_chans[i] = zmop_tcfg->midi_chans[i];
+		for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++)
+			zmop->route_from_zmips[izmip] = zmop_tcfg->route_from_zmips[izmip];
+		memcpy(zmop->cc_route, zmop_tcfg->cc_route, sizeof(zmop->cc_route));
+		zmop->note_low = zmop_tcfg->note_low;
+		zmop->note_high = zmop_tcfg->note_high;
+		zmop->transpose_octave = zmop_tcfg->transpose_octave;
+		zmop->transpose_semitone = zmop_tcfg->transpose_semitone;
+		zmop->n_connections = zmop_tcfg->n_connections;
+	}
+	router_config_commit();
+	return 1;
 }
 
 //-----------------------------------------------------
 // Jack Process
 //-----------------------------------------------------
 
+// Copy the events of a passthrough zmip straight to its output. Only Active Sense &
+// master channel messages are dropped, and note state is tracked for all-notes-off.
+static inline uint32_t zmip_process_passthrough(struct router_config_st * cfg, int izmip, int tracing) {
+	struct zmip_st * zmip = zmips + izmip;
+	int izmop = cfg->zmips[izmip].passthrough;
+	struct zmop_st * zmop = zmops + izmop;
+	struct zmop_config_st * zmop_cfg = cfg->zmops + izmop;
+	jack_midi_event_t ev;
+	uint32_t i = 0;
+	for (; i < zmip->event_count; i++) {
+		if (jack_midi_event_get(&ev, zmip->buffer, i) || ev.size == 0)
+			continue;
+		if (tracing)
+			router_trace_write_rt(ZYNMIDI_TRACE_EVENT, izmip, ev.time, ev.buffer, ev.size);
+		uint8_t b0 = ev.buffer[0];
+		if (b0 == ACTIVE_SENSE)
+			continue;
+		if (b0 < SYSTEM_EXCLUSIVE) {
+			if ((b0 & 0x0F) == cfg->midi_master_chan)
+				continue;
+			// Note on/off
+			if ((b0 & 0xE0) == 0x80 && ev.size == 3) {
+				if ((b0 >> 4) == NOTE_ON && ev.buffer[2] > 0)
+					zmop_note_on(zmop, b0 & 0x0F, ev.buffer[1] & 0x7F);
+				else
+					zmop_note_off(zmop, b0 & 0x0F, ev.buffer[1] & 0x7F);
+			}
+		}
+		zmop_output_plain(zmop, zmop_cfg, &ev);
+	}
+	zmip->next_event = zmip->event_count;
+	router_stats->zmips[izmip].events += i;
+	return i;
+}
+
 int jack_process(jack_nframes_t nframes, void *arg) {
+	// Profiling => start, end of setup, end of dispatch, end of flush
+	int profiling = __atomic_load_n(&router_profiling, __ATOMIC_ACQUIRE);
+	uint64_t prof_t[4] = {0};
+	uint32_t prof_events = 0;
+	if (profiling)
+		prof_t[0] = router_profile_now_ns();
+
+	// Ring-buffer events captured along the last period are scheduled along this one
+	jack_nframes_t cycle_frame_time = jack_last_frame_time(jack_client);
+	rb_frame_origin = cycle_frame_time - nframes;
+
+	// Get router configuration snapshot for this cycle => Read-only!
+	// Previous snapshot is never reused by writers while active, so comparing pointers is safe.
+	struct router_config_st * prev_cfg = router_config;
+	struct router_config_st * cfg = get_router_config();
+	if (!cfg)
+		return 0;
+	router_stats->cycles++;
+
+	// MIDI trace => record from the cycle applying the first traced configuration
+	if (__atomic_load_n(&router_trace_active, __ATOMIC_ACQUIRE)) {
+		if (cfg->trace_seq)
+			router_trace_write_rt(ZYNMIDI_TRACE_CYCLE, 0, cycle_frame_time, &nframes, sizeof(nframes));
+		if (cfg->trace_seq != router_trace_rt_seq) {
+			int starting = (router_trace_rt_seq == 0);
+			router_trace_rt_seq = cfg->trace_seq;
+			if (router_trace_rt_seq) {
+				router_trace_write_rt(ZYNMIDI_TRACE_CONFIG_APPLY, 0, router_trace_rt_seq, NULL, 0);
+				if (starting)
+					router_trace_write_state_rt();
+			}
+		}
+	} else {
+		router_trace_rt_seq = 0;
+	}
+	int tracing = router_trace_rt_seq != 0;
 
-	// Initialise zmops (MIDI output structures)
 	struct zmop_st * zmop;
-	for (int i = 0; i < MAX_NUM_ZMOPS; ++i) {
-		zmops[i].buffer = jack_port_get_buffer(zmops[i].jport, nframes);
-		if (zmops[i].buffer)
-			jack_midi_clear_buffer(zmops[i].buffer);
+	struct zmop_config_st * zmop_cfg;
+	// When connections change, clear once the buffer of disconnected zmops, so no stale events remain there
+	if (cfg != prev_cfg) {
+		for (int k = 0; k < n_live_zmops; ++k) {
+			int i = live_zmops[k];
+			zmop = zmops + i;
+			if (zmop->live && cfg->zmops[i].n_connections == 0) {
+				zmop->buffer = jack_port_get_buffer(zmop->jport, nframes);
+				if (zmop->buffer)
+					jack_midi_clear_buffer(zmop->buffer);
+				zmop->buffer = NULL;
+				zmop->live = 0;
+			}
+		}
+		memcpy(live_zmops, cfg->active_zmops, cfg->n_active_zmops);
+		n_live_zmops = cfg->n_active_zmops;
+	}
+
+	// Initialise zmops (MIDI output structures) => only connected ones
+	for (int k = 0; k < cfg->n_active_zmops; ++k) {
+		zmop = zmops + cfg->active_zmops[k];
+		zmop->buffer = jack_port_get_buffer(zmop->jport, nframes);
+		if (zmop->buffer)
+			jack_midi_clear_buffer(zmop->buffer);
+		zmop->live = 1;
+		zmop->last_time = 0;
 	}
 
-	// Initialise input structure for each MIDI input
+	// Send note-off for held notes in zmops with all-notes-off request, before any other event
+	zmops_process_all_notes_off(cfg);
+	if (zmips_notes_release)
+		zmips_process_notes_release(cfg);
+
+	// Internal events => UI
+	forward_zynmidi_internal(cfg);
+
+	// Initialise input structure for each active MIDI input and schedule the ones having events
 	struct zmip_st * zmip;
-	for (int i = 0; i < MAX_NUM_ZMIPS; ++i) {
+	struct zmip_config_st * zmip_cfg;
+	zmip_heap_reset();
+	for (int k = 0; k < cfg->n_active_zmips; ++k) {
+		int i = cfg->active_zmips[k];
 		zmip = zmips + i;
-		if (midi_learning_mode && i == ZMIP_CTRL)
+		if (cfg->midi_learning_mode && i == ZMIP_CTRL)
 			continue; // Don't feedback controls when learning
 		if (zmip->jport) {
 			zmip->buffer = jack_port_get_buffer(zmip->jport, nframes);
 			zmip->event_count = jack_midi_get_event_count(zmip->buffer);
 			zmip->next_event = 0;
+			// Plain device-to-device route => no merge, nor processing. An unfinished SysEx takes the full path.
+			if (cfg->zmips[i].passthrough >= 0 && zmip->sysex_state == SYSEX_IDLE) {
+				prof_events += zmip_process_passthrough(cfg, i, tracing);
+				continue;
+			}
 		}
 		populate_zmip_event(zmip);
+		if (zmip->event.time != 0xFFFFFFFF)
+			zmip_heap_push(i);
 	}
+	if (profiling)
+		prof_t[1] = router_profile_now_ns();
 
 	uint8_t event_idev;
 	uint8_t event_type;
@@ -1188,24 +3454,19 @@ int jack_process(jack_nframes_t nframes, void *arg) {
 	uint8_t event_num;
 	uint8_t event_val;
 	uint32_t ui_event;
-	int j, xch;
+	int xch;
 
 	// Process MIDI input messages in the order they were received
-	while (1) {
-		// Find the earliest unprocessed event from all input buffers
-		jack_nframes_t 	event_time = 0xFFFFFFFE; // Time of earliest unprocessed event (processed events have time set to 0xFFFFFFFF)
-		int izmip = -1;
-		for (int i = 0; i < MAX_NUM_ZMIPS; ++i) {
-			zmip = zmips + i;
-			if (zmip->event.time < event_time) {
-				event_time = zmip->event.time;
-				izmip = i;
-			}
-		}
-		if (izmip < 0)
-			break;
+	while (zmip_heap_size > 0) {
+		// The earliest unprocessed event from all input queues is on top of the heap
+		int izmip = zmip_heap[0];
 		zmip = zmips + izmip;
+		zmip_cfg = cfg->zmips + izmip;
 		jack_midi_event_t * ev = &(zmip->event);
+		router_stats->zmips[izmip].events++;
+		prof_events++;
+		if (tracing)
+			router_trace_write_rt(ZYNMIDI_TRACE_EVENT, izmip, ev->time, ev->buffer, ev->size);
 		//fprintf(stderr, "Found earliest event %0X at time %u:%u from input %d\n", ev->buffer[0], jack_last_frame_time(jack_client), ev->time, izmip);
 
 		// MIDI device index
@@ -1214,12 +3475,25 @@ int jack_process(jack_nframes_t nframes, void *arg) {
 		// Ignore Active Sense
 		//if (ev->buffer[0] == ACTIVE_SENSE || ev->buffer[0] == SYSTEM_EXCLUSIVE) // and SysEx messages
 		if (ev->buffer[0] == ACTIVE_SENSE)
-			goto event_processed; //!@TODO Handle Active Sense and SysEx
+			goto event_processed; //!@TODO Handle Active Sense
+
+		// Reassemble splitted SysEx messages
+		if (!zmip_sysex_reassemble(zmip, ev))
+			goto event_processed;
+
+		// Stage short messages in the ZMIP's own arena, so they can be modified without touching the
+		// source buffer (jack input port, lane ring-buffer or wrap buffer), nor aliasing other inputs.
+		// Unused bytes are zeroed => short messages read as 3 bytes give stable values.
+		if (ev->size <= 3) {
+			memset(zmip->stage, 0, ZMIP_STAGE_SIZE);
+			memcpy(zmip->stage, ev->buffer, ev->size);
+			ev->buffer = zmip->stage;
+		}
 
 		// Get event type & chan
 		if (ev->buffer[0] >= SYSTEM_EXCLUSIVE) {
 			// Ignore System Events depending on global flag
-			if (!midi_system_events)
+			if (!cfg->midi_system_events)
 				goto event_processed;
 			event_type = ev->buffer[0];
 			event_chan = 0;
@@ -1247,12 +3521,14 @@ int jack_process(jack_nframes_t nframes, void *arg) {
 
 		//fprintf(stderr, "MIDI EVENT: "); for(int x = 0; x < ev->size; ++x) fprintf(stderr, "%x ", ev->buffer[x]); fprintf(stderr, "\n");
 
-		// Event Mapping
-		if ((zmip->flags & FLAG_ZMIP_FILTER) && event_type >= NOTE_OFF && event_type <= PITCH_BEND) {
-			midi_event_t * event_map = &(midi_filter.event_map[event_type & 0x07][event_chan][event_num]);
+		// Event Mapping => Rows without rules pass through with a single bit test
+		if ((zmip_cfg->flags & FLAG_ZMIP_FILTER) && event_type >= NOTE_OFF && event_type <= PITCH_BEND
+			&& (zmip_cfg->midi_filter->has_rules[event_type & 0x07] & (1 << event_chan))) {
+			midi_filter_entry_t * event_map = &(zmip_cfg->midi_filter->rows[zmip_cfg->midi_filter->row[event_type & 0x07][event_chan]][event_num]);
 			//Ignore event...
 			if (event_map->type == IGNORE_EVENT) {
 				//fprintf(stderr, "IGNORE => %x, %x, %x\n",event_type, event_chan, event_num);
+				router_stats->zmips[izmip].drops[ZYNMIDI_DROP_FILTER]++;
 				goto event_processed;
 			}
 			//Map event ...
@@ -1281,9 +3557,12 @@ int jack_process(jack_nframes_t nframes, void *arg) {
 		}
 
 		// Just after mapping: Capture for UI or ignore MASTER CHANNEL events
-		if (event_type < SYSTEM_EXCLUSIVE && event_chan == midi_master_chan) {
-			if (zmip->flags & FLAG_ZMIP_UI) {
-				write_zynmidi((event_idev << 24) | (ev->buffer[0] << 16) | (ev->buffer[1] << 8) | (ev->buffer[2]));
+		if (event_type < SYSTEM_EXCLUSIVE && event_chan == cfg->midi_master_chan) {
+			if (zmip_cfg->flags & FLAG_ZMIP_UI) {
+				if (cfg->zynmidi_mode & ZYNMIDI_MODE_RECORDS)
+					write_zynmidi_record(ZYNMIDI_REC_MASTER, event_idev, cycle_frame_time + ev->time, ev->buffer, ev->size);
+				if (cfg->zynmidi_mode & ZYNMIDI_MODE_WORDS)
+					write_zynmidi((event_idev << 24) | (ev->buffer[0] << 16) | (ev->buffer[1] << 8) | (ev->buffer[2]));
 			}
 			goto event_processed;
 		}
@@ -1291,7 +3570,7 @@ int jack_process(jack_nframes_t nframes, void *arg) {
 		// MIDI CC messages
 		if (event_type == CTRL_CHANGE) {
 			//Auto Relative-Mode
-			if (zmip->flags & FLAG_ZMIP_CC_AUTO_MODE) {
+			if (zmip_cfg->flags & FLAG_ZMIP_CC_AUTO_MODE) {
 				if (zmip->ctrl_mode[event_chan][event_num] == CTRL_MODE_REL_2) {
 					// Change to absolute mode
 					if (zmip->ctrl_relmode_count[event_chan][event_num] > 1) {
@@ -1342,278 +3621,443 @@ int jack_process(jack_nframes_t nframes, void *arg) {
 		}
 
 		// Capture events for UI ...
-		if (zmip->flags & FLAG_ZMIP_UI) {
-			if (event_type == SYSTEM_EXCLUSIVE) {
-				// Send SysEx in fragments of 4-bytes
-				//fprintf(stderr, "SysEx message received from %d => %d bytes...\n", event_idev, ev->size);
-				int j = 0;
-				int r = 1;
-				uint32_t buf32 = event_idev << 8;
-				while (1) {
-					buf32 |= ev->buffer[j];
-					if (r < 3) {
-						buf32 <<= 8;
-						r++;
-					} else {
-						write_zynmidi(buf32);
-						buf32 = r = 0;
-					}
-					// Detect end-of-sysex marker
-					if (ev->buffer[j] == 0xF7) break;
-					j++;
-					// Concatenate chunks when the SysEx data is splitted in several MIDI messages
-					if (j >= ev->size) {
-						populate_zmip_event(zmip);
-						// TODO: we should continue reading in the next periods until complete!
-						if (zmip->event.time == 0xFFFFFFFF) {
-							fprintf(stderr, "Splitted SysEx message has not end mark!\n");
+		if (zmip_cfg->flags & FLAG_ZMIP_UI) {
+			// Records: whole message with source & time
+			if (cfg->zynmidi_mode & ZYNMIDI_MODE_RECORDS)
+				write_zynmidi_record(ZYNMIDI_REC_MIDI, event_idev, cycle_frame_time + ev->time, ev->buffer, ev->size);
+			// 4-bytes words
+			if (cfg->zynmidi_mode & ZYNMIDI_MODE_WORDS) {
+				if (event_type == SYSTEM_EXCLUSIVE) {
+					// Send SysEx in fragments of 4-bytes
+					//fprintf(stderr, "SysEx message received from %d => %d bytes...\n", event_idev, ev->size);
+					int j = 0;
+					int r = 1;
+					uint32_t buf32 = event_idev << 8;
+					while (1) {
+						buf32 |= ev->buffer[j];
+						if (r < 3) {
+							buf32 <<= 8;
+							r++;
+						} else {
+							write_zynmidi(buf32);
+							buf32 = r = 0;
+						}
+						// Detect end-of-sysex marker
+						if (ev->buffer[j] == 0xF7) break;
+						j++;
+						// SysEx is complete here (reassembled if splitted) => it must have end mark
+						if (j >= ev->size) {
+							zynlog(ZYNLOG_SYSEX_NO_END_MARK, izmip, ev->size);
+							goto event_processed;
+						}
+						// Detect malformed messages (wrong byte values)
+						if (ev->buffer[j] > 0x7F && ev->buffer[j] != 0xF7) {
+							zynlog(ZYNLOG_SYSEX_MALFORMED, izmip, j);
 							goto event_processed;
 						}
-						j = 0;
 					}
-					// Detect malformed messages (wrong byte values)
-					if (ev->buffer[j] > 0x7F && ev->buffer[j] != 0xF7) {
-						fprintf(stderr, "Malformed SysEx message!\n");
-						goto event_processed;
+					// Complete and send last 4-bytes fragment
+					if (r > 0) {
+					    buf32 <<= (3 - r) * 8;
+						write_zynmidi(buf32);
 					}
+				} else {
+					write_zynmidi((event_idev << 24) | (ev->buffer[0] << 16) | (ev->buffer[1] << 8) | (ev->buffer[2]));
 				}
-				// Complete and send last 4-bytes fragment
-				if (r > 0) {
-				    buf32 <<= (3 - r) * 8;
-					write_zynmidi(buf32);
-				}
-			} else {
-				write_zynmidi((event_idev << 24) | (ev->buffer[0] << 16) | (ev->buffer[1] << 8) | (ev->buffer[2]));
 			}
 		}
 
 		//printf("ZynMidiRouter: Processing event from zmip %d, type %d, channel %d, translated to channel %d\n", izmip, event_type, event_chan, event_chan_translated);
 
-		// Send the processed message to configured output queues
+		// Send the processed message to configured output queues => only routed & connected zmops
 		uint8_t event_b0 = ev->buffer[0];
-		uint8_t event_chan_trans;
-		for (int izmop = 0; izmop < MAX_NUM_ZMOPS; ++izmop) {
+		int n_sent = 0;
+		// ACTI note-off => get zmops that received the matching note-on
+		uint64_t * note_owners = NULL;
+		uint64_t note_off_owners = 0;
+		if ((zmip_cfg->flags & FLAG_ZMIP_ACTIVE_CHAIN) && zmip->note_owners && (event_type == NOTE_ON || event_type == NOTE_OFF)) {
+			note_owners = &zmip->note_owners[event_chan][event_num];
+			if (event_type == NOTE_OFF || event_val == 0) {
+				note_off_owners = *note_owners;
+				*note_owners = 0;
+			}
+		}
+		// Status-byte tables for the zmip's kind => ACTI or not
+		int status_acti = (zmip_cfg->flags & FLAG_ZMIP_ACTIVE_CHAIN) ? 1 : 0;
+		for (int k = 0; k < zmip_cfg->n_fanout; ++k) {
+			int izmop = zmip_cfg->fanout[k];
 			zmop = zmops + izmop;
+			zmop_cfg = cfg->zmops + izmop;
+			struct zmop_status_st st = cfg->zmop_status[izmop][status_acti][event_b0];
 
-			// Don't waste CPU cycles with unconnected output ports. Nobody is listening there!!
-			if (zmop->n_connections==0)
-				continue;
-
-			// Do not send to unrouted output ports
-			if (!zmop->route_from_zmips[izmip])
-				continue;
-
-			// Channel messages ...
-			if (event_type < SYSTEM_EXCLUSIVE) {
-				event_chan_trans = event_chan;
-				// If zmop have enabled Channel Translation / Channel Filtering (ACTI/MULTI) and
-				// has a single midi_chan (aka it's not using multi-channel mapping! => ALL CHANS)
-				if (zmop->flags & FLAG_ZMOP_CHAN_TRANSFILTER && zmop->midi_chan >= 0) {
-					// ACTI => route events to active chain, translating channel as required  ...
-					if (zmip->flags & FLAG_ZMIP_ACTIVE_CHAIN) {
-						// If (active MIDI channel
-						if (((active_midi_chan && zmops[active_chain].midi_chan == zmop->midi_chan) ||
-						// or active chain)
-						izmop == active_chain) &&
-						// and output midi channel is mapped => Send to active zmop's MIDI channel
-						zmop->midi_chans[zmop->midi_chan] >= 0) {
-							// NOTE-OFF => Release pressed notes across active chain changes
-							if (event_type == NOTE_OFF || (event_type == NOTE_ON && event_val == 0)) {
-								// If not matching note-on on this chain, try rest of chains ...
-								if (zmop->note_state[event_num] == 0) {
-									for (j = 1; j < NUM_ZMOP_CHAINS; j++) {
-										int xiz = (izmop + j) % NUM_ZMOP_CHAINS;
-										// If found a matching note-on for this note-off event on other chain
-										if (zmops[xiz].note_state[event_num] > 0 && zmops[xiz].midi_chan >= 0 && zmops[xiz].n_connections > 0  && zmops[xiz].route_from_zmips[izmip]) {
-											zmop = 	zmops + xiz;
-											break;
-										}
-									}
-								}
-							}
-							// Update event data with the translated MIDI channel
-							event_chan_trans = zmop->midi_chan;
-							ev->buffer[0] = (ev->buffer[0] & 0xF0) | (event_chan_trans & 0x0F);
-						}
-						// or discard message from not active zmops
-						else {
+			// Channel translation & filtering, DROP* flags => most events have nothing to check
+			if (st.op) {
+				if (st.op & ZMOP_STATUS_DROP)
+					continue;
+				if (st.op & ZMOP_STATUS_ACTI) {
+					// NOTE-OFF => Release pressed notes across active chain changes: send to zmops owning the note
+					if (note_off_owners) {
+						if (!(note_off_owners & (1ULL << izmop)))
 							continue;
-						}
 					}
-					// MULTI => no translate, but filter MIDI channels not configured in zmop
-					else if (zmop->midi_chans[event_chan] == -1) {
+					// Discard message from not active zmops
+					else if (st.op & ZMOP_STATUS_INACTIVE) {
 						continue;
 					}
 				}
-				// No Channel Translation & No Channel Filtering:
-				// + Ignore ACTI/MULTI flag
-				// + ALL channel messages pass untranslated
-				else {
-					// Discard messages in disabled channels
-					if (zmop->midi_chans[event_chan] == -1)
-						continue;
-					// Leave MIDI channel untouched
-					//fprintf(stderr, "MIDI message untouched to ZMOP %d => %d, %d, 0x%x!\n", izmop, izmip, event_chan, event_type);
-				}
-
 				// Drop "CC messages" if configured in zmop options, except from internal sources (UI, etc.)
-				if (event_type == CTRL_CHANGE && (zmop->flags & FLAG_ZMOP_DROPCC && zmop->cc_route[event_num] == 0) && izmip <= ZMIP_CTRL)
-					goto zmop_event_processed;
-
+				if ((st.op & ZMOP_STATUS_DROPCC) && cfg->zmop_cc_route[izmop][event_num] == 0 && zmip_cfg->external) {
+					router_stats->zmops[izmop].drops[ZYNMIDI_DROP_CC]++;
+					continue;
+				}
 				// Drop "Program Change" if configured in zmop options, except from internal sources (UI)
-				if (event_type == PROG_CHANGE && (zmop->flags & FLAG_ZMOP_DROPPC) && izmip != ZMIP_FAKE_UI)
-					goto zmop_event_processed;
-
+				if ((st.op & ZMOP_STATUS_DROPPC) && izmip != ZMIP_FAKE_UI) {
+					router_stats->zmops[izmop].drops[ZYNMIDI_DROP_PC]++;
+					continue;
+				}
 				// Drop "Note On/Off" if configured in zmop options, except from internal sources (UI)
-				if ((zmop->flags & FLAG_ZMOP_DROPNOTE) && (event_type == NOTE_ON || event_type == NOTE_OFF) && izmip != ZMIP_FAKE_UI)
-					goto zmop_event_processed;
-
-				// Save note state for each zmop
-				if (event_type == NOTE_ON)
-					zmop->note_state[event_num] = event_val;
-				else if (event_type == NOTE_OFF)
-					zmop->note_state[event_num] = 0;
-			}
-			// Drop "System messages" if configured in zmop options, except from internal sources (UI)
-			else if ((event_type > SYSTEM_EXCLUSIVE) && (zmop->flags & FLAG_ZMOP_DROPSYS) && izmip != ZMIP_FAKE_UI) {
-			 	continue;
-			}
-			// Drop "System Exclusive messages" if configured in zmop options
-			else if ((event_type == SYSTEM_EXCLUSIVE) && (zmop->flags & FLAG_ZMOP_DROPSYSEX)) {
-			 	continue;
+				if ((st.op & ZMOP_STATUS_DROPNOTE) && izmip != ZMIP_FAKE_UI) {
+					router_stats->zmops[izmop].drops[ZYNMIDI_DROP_NOTE]++;
+					continue;
+				}
+				// Drop "System messages" if configured in zmop options, except from internal sources (UI)
+				if ((st.op & ZMOP_STATUS_DROPSYS) && izmip != ZMIP_FAKE_UI)
+					continue;
+				// Save note state for each zmop, in the (translated) MIDI channel, and note ownership for ACTI zmips
+				if (st.op & ZMOP_STATUS_NOTE) {
+					if (event_type == NOTE_ON && event_val > 0) {
+						zmop_note_on(zmop, st.status & 0x0F, event_num);
+						if (note_owners)
+							*note_owners |= 1ULL << izmop;
+					} else {
+						zmop_note_off(zmop, st.status & 0x0F, event_num);
+					}
+				}
 			}
 
-			// Add processed event to MIDI output port buffer
-			zmop_push_event(zmop, ev);
-
-			zmop_event_processed:
- 			// Restore original channel in event object before processing next zmop
- 			ev->buffer[0] = event_b0;
+			// Add processed event to MIDI output port buffer, using the zmop's specialized handler.
+			// Event is shared by all zmops => restore original channel after sending it translated.
+			if (st.status != event_b0) {
+				ev->buffer[0] = st.status;
+				zmop_cfg->output(zmop, zmop_cfg, ev);
+				ev->buffer[0] = event_b0;
+			} else {
+				zmop_cfg->output(zmop, zmop_cfg, ev);
+			}
+			n_sent++;
 		}
 
+		// Event was not sent to any zmop. ctrl_in is only captured by UI.
+		if (n_sent == 0 && izmip != ZMIP_CTRL)
+			router_stats->zmips[izmip].drops[ZYNMIDI_DROP_UNROUTED]++;
+
 		event_processed:
+		// Release reassembled SysEx buffer
+		if (zmip->sysex_state == SYSEX_COMPLETE)
+			zmip_sysex_reset(zmip);
 		// After processing (or ignoring) event, get the next event from this input queue and try it all again...
 		populate_zmip_event(zmip);
+		zmip_heap_update_top();
 	}
+	if (profiling)
+		prof_t[2] = router_profile_now_ns();
 
 	// Flush ZMOP direct events from ring-buffers (FLAG_ZMOP_DIRECTOUT)
 	jack_midi_event_t ev;
-	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+	for (int k = 0; k < cfg->n_directout_zmops; k++) {
+		int izmop = cfg->directout_zmops[k];
 		zmop = zmops + izmop;
-		if ((zmop->flags & FLAG_ZMOP_DIRECTOUT) && zmop->rbuffer!=NULL) {
-			// Take events from ring-buffer and write them to jack output buffer ...
-			while (1) {
-				populate_midi_event_from_rb(zmop->rbuffer, &ev);
-				if (ev.time==0xFFFFFFFF) break;
-				// Do not send to unconnected output ports
-				if (zmop->n_connections==0)
-					continue;
-				if (jack_midi_event_write(zmop->buffer, ev.time, ev.buffer, ev.size))
-					fprintf(stderr, "ZynMidiRouter: Error writing jack midi output event!\n");
+		zmop_cfg = cfg->zmops + izmop;
+		// Take events from ring-buffer and write them to jack output buffer ...
+		size_t rsize;
+		while ((rsize = populate_midi_event_from_rb(zmop->rbuffer, &ev, rb_wrap_buffer))) {
+			// Do not send to unconnected output ports
+			if (zmop_cfg->n_connections > 0) {
+				// Jack buffer events must be sorted => Don't go before routed events
+				if (ev.time < zmop->last_time)
+					ev.time = zmop->last_time;
+				zmop->last_time = ev.time;
+				if (jack_midi_event_write(zmop->buffer, ev.time, ev.buffer, ev.size)) {
+					router_stats->zmops[izmop].drops[ZYNMIDI_DROP_OUTPUT_FULL]++;
+					zynlog(ZYNLOG_MIDI_OUT_WRITE_ERROR, izmop, 0);
+				} else {
+					router_stats->zmops[izmop].events++;
+				}
 			}
+			jack_ringbuffer_read_advance(zmop->rbuffer, rsize);
 		}
 	}
+
+	if (profiling) {
+		prof_t[3] = router_profile_now_ns();
+		router_profile_update(prof_t, prof_events, nframes, cycle_frame_time);
+	}
 	return 0;
 }
 
+// Process all-notes-off requests. Cost is proportional to the held notes.
+void zmops_process_all_notes_off(struct router_config_st * cfg) {
+	uint64_t req = __atomic_exchange_n(&all_notes_off_request, 0, __ATOMIC_ACQ_REL);
+	if (req && router_trace_rt_seq)
+		router_trace_write_rt(ZYNMIDI_TRACE_ALL_NOTES_OFF, 0, 0, &req, sizeof(req));
+	while (req) {
+		int izmop = __builtin_ctzll(req);
+		req &= req - 1;
+		zmop_all_notes_off(zmops + izmop, cfg->zmops + izmop);
+	}
+}
+
+// Send note-off for the notes owned by ACTI zmips turned inactive, to the owner zmops, and forget them.
+// Otherwise, notes held in a removed or disconnected device would hang.
+void zmips_process_notes_release(struct router_config_st * cfg) {
+	jack_midi_data_t buffer[3];
+	jack_midi_event_t ev;
+	ev.time = 0;
+	ev.size = 3;
+	ev.buffer = buffer;
+	uint64_t req = zmips_notes_release;
+	zmips_notes_release = 0;
+	while (req) {
+		int izmip = __builtin_ctzll(req);
+		req &= req - 1;
+		uint64_t (*owners)[128] = zmips[izmip].note_owners;
+		for (int chan = 0; chan < 16; chan++) {
+			for (int note = 0; note < 128; note++) {
+				uint64_t mask = owners[chan][note];
+				owners[chan][note] = 0;
+				while (mask) {
+					int izmop = __builtin_ctzll(mask);
+					mask &= mask - 1;
+					struct zmop_st * zmop = zmops + izmop;
+					struct zmop_config_st * zmop_cfg = cfg->zmops + izmop;
+					// Unconnected zmops have no buffer (nor status table) => notes are forgotten by all-notes-off
+					if (zmop_cfg->n_connections <= 0)
+						continue;
+					struct zmop_status_st st = cfg->zmop_status[izmop][1][(NOTE_OFF << 4) | chan];
+					uint8_t zmop_chan = st.status & 0x0F;
+					if ((st.op & ZMOP_STATUS_DROP) || !(zmop->note_bits[zmop_chan][note >> 6] & (1ULL << (note & 0x3F))))
+						continue;
+					zmop_note_off(zmop, zmop_chan, note);
+					buffer[0] = st.status;
+					buffer[1] = note;
+					buffer[2] = 0;
+					zmop_cfg->output(zmop, zmop_cfg, &ev);
+				}
+			}
+		}
+	}
+}
+
+// Send note-off for all held notes, through the zmop's output handler (transpose, channel translation, etc.)
+void zmop_all_notes_off(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg) {
+	jack_midi_data_t buffer[3];
+	jack_midi_event_t ev;
+	ev.time = 0;
+	ev.size = 3;
+	ev.buffer = buffer;
+	uint16_t chans = zmop->note_chans;
+	while (chans) {
+		int chan = __builtin_ctz(chans);
+		chans &= chans - 1;
+		for (int w = 0; w < 2; w++) {
+			uint64_t bits = zmop->note_bits[chan][w];
+			// Unconnected zmops have no buffer => just forget notes
+			while (bits && zmop_cfg->n_connections > 0) {
+				buffer[0] = (NOTE_OFF << 4) | chan;
+				buffer[1] = (w << 6) | __builtin_ctzll(bits);
+				buffer[2] = 0;
+				zmop_cfg->output(zmop, zmop_cfg, &ev);
+				bits &= bits - 1;
+			}
+			zmop->note_bits[chan][w] = 0;
+		}
+	}
+	zmop->note_chans = 0;
+}
+
 //  Post-process midi message and add to output buffer
 //	zmop: Pointer to the zmop describing the MIDI output
+//	zmop_cfg: Pointer to the zmop's config snapshot
 //	ev: Pointer to a valid jack midi event
-void zmop_push_event(struct zmop_st * zmop, jack_midi_event_t * ev) {
+void zmop_push_event(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev) {
 	if (!zmop)
 		return;
+	zmop_cfg->output(zmop, zmop_cfg, ev);
+}
 
-	uint8_t event_type = ev->buffer[0] >> 4;
-	uint8_t event_chan = ev->buffer[0] & 0x0F;
-	int event_num = -1;
+//-----------------------------------------------------------------------------
+// ZMOP output handlers
+//-----------------------------------------------------------------------------
+// Each zmop config has an output handler, selected from its flags when publishing
+// the router config. Events are copied to the jack buffer once and modified there,
+// so the source event is left untouched for the next zmop.
+
+// Select output handler from zmop flags
+zmop_output_handler_t zmop_select_output_handler(uint32_t flags, int tuning_pitchbend) {
+	int noterange = flags & FLAG_ZMOP_NOTERANGE;
+	int chantrans = flags & FLAG_ZMOP_CHAN_TRANSFILTER;
+	int tuning = (flags & FLAG_ZMOP_TUNING) && tuning_pitchbend >= 0;
+	if (noterange)
+		return (chantrans || tuning) ? zmop_output_generic : zmop_output_noterange;
+	if (chantrans)
+		return tuning ? zmop_output_chantrans_tuning : zmop_output_chantrans;
+	if (tuning)
+		return zmop_output_generic;
+	return zmop_output_plain;
+}
+
+// Reserve space in zmop's jack buffer and copy event. Returns the copy, to be modified in place.
+static inline jack_midi_data_t * zmop_write_event(struct zmop_st * zmop, jack_midi_event_t * ev) {
+	jack_midi_data_t * buf = jack_midi_event_reserve(zmop->buffer, ev->time, ev->size);
+	if (!buf) {
+		router_stats->zmops[zmop - zmops].drops[ZYNMIDI_DROP_OUTPUT_FULL]++;
+		zynlog(ZYNLOG_MIDI_OUT_WRITE_ERROR, zmop - zmops, 0);
+		return NULL;
+	}
+	router_stats->zmops[zmop - zmops].events++;
+	memcpy(buf, ev->buffer, ev->size);
+	zmop->last_time = ev->time;
+	return buf;
+}
+
+// Note-range & transpose note-on/off messages. Returns transposed note or -1 if it must be dropped.
+static inline int zmop_transpose_note(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, uint8_t event_type, uint8_t event_num) {
+	int8_t offset;
+	// Note-off => Send the note-off with the same transpose value that the tracked note-on
+	if (event_type == NOTE_OFF) {
+		offset = zmop->note_transpose[event_num];
+	}
+	// Note-on
+	else {
+		// Note-range
+		if (event_num < zmop_cfg->note_low || event_num > zmop_cfg->note_high)
+			return -1; // Raw note out of range
+
+		// Transpose
+		offset = zmop_cfg->transpose_octave * 12 + zmop_cfg->transpose_semitone + router_config->global_transpose;
+		zmop->note_transpose[event_num] = offset;
+	}
+	int note = event_num + offset;
+	if (note > 0x7F || note < 0)
+		return -1; // Transposed note out of range
+	return note;
+}
+
+// Translate MIDI channel of channel messages already written to the jack buffer. Returns the resulting channel.
+static inline uint8_t zmop_translate_chan(struct zmop_config_st * zmop_cfg, jack_midi_data_t * buf, uint8_t event_type) {
+	uint8_t event_chan = buf[0] & 0x0F;
+	if (event_type >= NOTE_OFF && event_type <= PITCH_BEND) {
+		event_chan = zmop_cfg->midi_chans[event_chan] & 0x0F;
+		buf[0] = (buf[0] & 0xF0) | event_chan;
+	}
+	return event_chan;
+}
+
+// Fine-Tuning, using pitch-bending messages. Called after writing the core event.
+static inline void zmop_tune_event(struct zmop_st * zmop, jack_midi_data_t * buf, jack_nframes_t time, uint8_t event_type, uint8_t event_chan) {
+	if (event_type == NOTE_ON) {
+		int pb = get_tuned_pitchbend(zmop->last_pb_val[event_chan]);
+		jack_midi_data_t * xbuf = jack_midi_event_reserve(zmop->buffer, time, 3);
+		if (!xbuf) {
+			router_stats->zmops[zmop - zmops].drops[ZYNMIDI_DROP_OUTPUT_FULL]++;
+			zynlog(ZYNLOG_MIDI_OUT_WRITE_ERROR, zmop - zmops, 0);
+			return;
+		}
+		xbuf[0] = (PITCH_BEND << 4) | event_chan;
+		xbuf[1] = pb & 0x7F;
+		xbuf[2] = (pb >> 7) & 0x7F;
+	} else if (event_type == PITCH_BEND) {
+		//Get received PB & save it
+		int pb = (buf[2] << 7) | buf[1];
+		zmop->last_pb_val[event_chan] = pb;
+		//Calculate tuned PB
+		pb = get_tuned_pitchbend(pb);
+		buf[1] = pb & 0x7F;
+		buf[2] = (pb >> 7) & 0x7F;
+	}
+}
 
-	if ((zmop->flags & FLAG_ZMOP_NOTERANGE) && (event_type == NOTE_OFF || event_type == NOTE_ON)) {		
-		// Note-range & Transpose Note-on/off messages
-		int8_t offset;
-		event_num = ev->buffer[1];
+// No post-processing
+void zmop_output_plain(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev) {
+	zmop_write_event(zmop, ev);
+}
 
-		// Note-off => Send the note-off with the same transpose value that the tracked note-on
-		if (event_type == NOTE_OFF) {
-			offset = zmop->note_transpose[event_num];
-		}
-		// Note-on
-		else {
-			// Note-range
-			if (event_num < zmop->note_low || event_num > zmop->note_high)
-				return; // Raw note out of range
-
-			// Transpose
-			offset = zmop->transpose_octave * 12 + zmop->transpose_semitone + global_transpose;
-			zmop->note_transpose[event_num] = offset;
-		}
-		// Transpose note event
-		int note = event_num + offset;
-		if (note > 0x7F || note < 0)
-			return; // Transposed note out of range
-		ev->buffer[1] = (uint8_t)(note & 0x7F);
-	}
-
-	// Channel translation
-	if ((zmop->flags & FLAG_ZMOP_CHAN_TRANSFILTER) && event_type >= NOTE_OFF && event_type <= PITCH_BEND) {
-		event_chan = zmop->midi_chans[event_chan] & 0x0F;
-		ev->buffer[0] = (ev->buffer[0] & 0xF0) | event_chan;
-	}
-	
-	// Fine-Tuning, using pitch-bending messages ...
-	jack_midi_event_t xev;
-	jack_midi_data_t xev_buffer[3];
-	xev.size=0;
-	if ((zmop->flags & FLAG_ZMOP_TUNING) && tuning_pitchbend >= 0) {
-		if (event_type == NOTE_ON) {
-			int pb = zmop->last_pb_val[event_chan];
-			//fprintf(stderr, "NOTE-ON PITCHBEND=%d (%d)\n", pb, zmop->tuning_pitchbend);
-			pb = get_tuned_pitchbend(pb);
-			//fprintf(stderr, "NOTE-ON TUNED PITCHBEND=%d\n",pb);
-			xev.buffer = (jack_midi_data_t *) &xev_buffer;
-			xev.buffer[0] = (PITCH_BEND << 4) | event_chan;
-			xev.buffer[1] = pb & 0x7F;
-			xev.buffer[2] = (pb >> 7) & 0x7F;
-			xev.size=3;
-			xev.time = ev->time;
-		} else if (event_type == PITCH_BEND) {
-			//Get received PB
-			int pb = (ev->buffer[2] << 7) | ev->buffer[1];
-			//Save last received PB value ...
-			zmop->last_pb_val[event_chan] = pb;
-			//Calculate tuned PB
-			//fprintf(stderr, "PITCHBEND=%d\n",pb);
-			pb = get_tuned_pitchbend(pb);
-			//fprintf(stderr, "TUNED PITCHBEND=%d\n",pb);
-			ev->buffer[1] = pb & 0x7F;
-			ev->buffer[2] = (pb >> 7) & 0x7F;
+// Note-range & transpose
+void zmop_output_noterange(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev) {
+	uint8_t event_type = ev->buffer[0] >> 4;
+	if (event_type == NOTE_OFF || event_type == NOTE_ON) {
+		int note = zmop_transpose_note(zmop, zmop_cfg, event_type, ev->buffer[1]);
+		if (note < 0) {
+			router_stats->zmops[zmop - zmops].drops[ZYNMIDI_DROP_NOTERANGE]++;
+			return;
 		}
+		jack_midi_data_t * buf = zmop_write_event(zmop, ev);
+		if (buf)
+			buf[1] = (uint8_t)note;
+	} else {
+		zmop_write_event(zmop, ev);
 	}
+}
+
+// Channel translation
+void zmop_output_chantrans(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev) {
+	jack_midi_data_t * buf = zmop_write_event(zmop, ev);
+	if (buf)
+		zmop_translate_chan(zmop_cfg, buf, buf[0] >> 4);
+}
 
-	// Add core event to output
-	if (jack_midi_event_write(zmop->buffer, ev->time, ev->buffer, ev->size))
-		fprintf(stderr, "ZynMidiRouter: Error writing jack midi output event!\n");
+// Channel translation & fine-tuning
+void zmop_output_chantrans_tuning(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev) {
+	jack_midi_data_t * buf = zmop_write_event(zmop, ev);
+	if (buf) {
+		uint8_t event_type = buf[0] >> 4;
+		uint8_t event_chan = zmop_translate_chan(zmop_cfg, buf, event_type);
+		zmop_tune_event(zmop, buf, ev->time, event_type, event_chan);
+	}
+}
 
-	// Add tuning event to output
-	if (xev.size > 0)
-		if (jack_midi_event_write(zmop->buffer, xev.time, xev.buffer, ev->size))
-			fprintf(stderr, "ZynMidiRouter: Error writing jack midi output event!\n");
-	
-	// Restore the original note before transpose
-	if (event_num >= 0)
-		ev->buffer[1] = (uint8_t)(event_num & 0x7F);
+// Any combination of flags
+void zmop_output_generic(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev) {
+	uint8_t event_type = ev->buffer[0] >> 4;
+	int note = -1;
+	if ((zmop_cfg->flags & FLAG_ZMOP_NOTERANGE) && (event_type == NOTE_OFF || event_type == NOTE_ON)) {
+		note = zmop_transpose_note(zmop, zmop_cfg, event_type, ev->buffer[1]);
+		if (note < 0) {
+			router_stats->zmops[zmop - zmops].drops[ZYNMIDI_DROP_NOTERANGE]++;
+			return;
+		}
+	}
+	jack_midi_data_t * buf = zmop_write_event(zmop, ev);
+	if (!buf)
+		return;
+	if (note >= 0)
+		buf[1] = (uint8_t)note;
+	uint8_t event_chan = buf[0] & 0x0F;
+	if (zmop_cfg->flags & FLAG_ZMOP_CHAN_TRANSFILTER)
+		event_chan = zmop_translate_chan(zmop_cfg, buf, event_type);
+	if ((zmop_cfg->flags & FLAG_ZMOP_TUNING) && router_config->tuning_pitchbend >= 0)
+		zmop_tune_event(zmop, buf, ev->time, event_type, event_chan);
 }
 
 
 void jack_connect_cb(jack_port_id_t a, jack_port_id_t b, int connect, void *arg) {
-	// Get number of connection of Output Ports
+	// Get number of connection of Input & Output Ports
+	router_config_begin();
+	for (int i = 0; i < MAX_NUM_ZMIPS; i++) {
+		if (zmips[i].registered && zmips[i].jport)
+			zmips[i].n_connections = jack_port_connected(zmips[i].jport);
+	}
 	for (int i = 0; i < MAX_NUM_ZMOPS; i++) {
-		zmops[i].n_connections = jack_port_connected(zmops[i].jport);
+		if (zmops[i].registered && zmops[i].jport)
+			zmops[i].n_connections = jack_port_connected(zmops[i].jport);
 	}
+	router_config_commit();
 	//fprintf(stderr, "ZynMidiRouter: Num. of connections refreshed\n");
 
 }
 
 int jack_buffer_size_change(jack_nframes_t nframes, void* arg) {
+	router_stats->buffer_size = nframes;
 	if (nframes)
 		last_frame = nframes - 1;
 	else
@@ -1625,13 +4069,25 @@ int jack_buffer_size_change(jack_nframes_t nframes, void* arg) {
 // Direct Send Event Ring-Buffer write
 //-----------------------------------------------------------------------------
 
-int write_rb_midi_event(jack_ringbuffer_t *rb, uint8_t *event_buffer, int event_size) {
-	if (jack_ringbuffer_write_space(rb) >= event_size) {
-		if (jack_ringbuffer_write(rb, event_buffer, event_size) != event_size) {
-			fprintf(stderr, "ZynMidiRouter: Error writing ring-buffer: INCOMPLETE\n");
-			return 0;
-		}
+// Write a framed record to ring-buffer: header + event. The record is published at once, so it's never read incomplete.
+int write_rb_midi_event(jack_ringbuffer_t *rb, uint8_t *event_buffer, int event_size, struct zynmidi_port_stats_st * port_stats) {
+	if (event_size <= 0) {
+		fprintf(stderr, "ZynMidiRouter: Error writing ring-buffer: BAD SIZE (%d)\n", event_size);
+		return 0;
+	}
+	struct rb_midi_record_st hdr;
+	hdr.size = event_size;
+	hdr.time = jack_frame_time(jack_client);
+	size_t size = sizeof(hdr) + event_size;
+	if (jack_ringbuffer_write_space(rb) >= size) {
+		jack_ringbuffer_data_t vec[2];
+		jack_ringbuffer_get_write_vector(rb, vec);
+		rb_vector_write(vec, 0, &hdr, sizeof(hdr));
+		rb_vector_write(vec, sizeof(hdr), event_buffer, event_size);
+		jack_ringbuffer_write_advance(rb, size);
 	} else {
+		// Several producer threads => atomic increment
+		__atomic_fetch_add(&port_stats->drops[ZYNMIDI_DROP_RING_FULL], 1, __ATOMIC_RELAXED);
 		fprintf(stderr, "ZynMidiRouter: Error writing ring-buffer: FULL\n");
 		return 0;
 	}
@@ -1647,7 +4103,19 @@ int zmip_send_midi_event(uint8_t iz, uint8_t *event_buffer, int event_size) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
 		return 0;
 	}
-	return write_rb_midi_event(zmips[iz].rbuffer, event_buffer, event_size);
+	if (!zmips[iz].lanes) {
+		fprintf(stderr, "ZynMidiRouter: Input port (%d) is not a direct input.\n", iz);
+		return 0;
+	}
+	// Leased lane => single producer, no locking
+	int il = zmip_get_lane(iz);
+	if (il)
+		return write_rb_midi_event(zmips[iz].lanes[il].rbuffer, event_buffer, event_size, router_stats->zmips + iz);
+	// Shared lane
+	pthread_mutex_lock(&zmip_shared_lane_mutex);
+	int res = write_rb_midi_event(zmips[iz].lanes[0].rbuffer, event_buffer, event_size, router_stats->zmips + iz);
+	pthread_mutex_unlock(&zmip_shared_lane_mutex);
+	return res;
 }
 
 int zmip_send_note_off(uint8_t iz, uint8_t chan, uint8_t note, uint8_t vel) {
@@ -1705,25 +4173,14 @@ int zmip_send_pitchbend_change(uint8_t iz, uint8_t chan, uint16_t pb) {
 	return zmip_send_midi_event(iz, buffer, 3);
 }
 
+// Held notes are released by jack process at the start of next cycle, sending note-off directly to zmops
 int zmip_send_all_notes_off(uint8_t iz) {
 	if (iz >= MAX_NUM_ZMIPS) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
 		return 0;
 	}
-	int izmop, chan, note;
-	uint8_t buffer[3];
-	buffer[2] = 0;
-	for (izmop = 0; izmop < ZMOP_CTRL; izmop++) {
-		chan = zmops[izmop].midi_chan;
-		if (chan < 0) chan = 0;
-		buffer[0] = 0x80 + (chan & 0x0F);
-		for (note = 0; note < 128; note++) {
-			buffer[1] = note;
-			if (zmops[izmop].note_state[note] > 0)
-				if (!write_rb_midi_event(zmips[iz].rbuffer, buffer, 3))
-					return 0;
-		}
-	}
+	// All zmops before ZMOP_CTRL => chains, mod & step
+	__atomic_fetch_or(&all_notes_off_request, (1ULL << ZMOP_CTRL) - 1, __ATOMIC_RELEASE);
 	return 1;
 }
 
@@ -1736,18 +4193,7 @@ int zmip_send_all_notes_off_chain(uint8_t iz, uint8_t izmop) {
 		fprintf(stderr, "ZynMidiRouter:zmip_send_all_notes_off_chain(%d, zmop) => zmop (%d) is out of range!\n", iz, izmop);
 		return 0;
 	}
-	uint8_t note;
-	uint8_t chan = zmops[izmop].midi_chan;
-	if (chan < 0) chan = 0;
-	uint8_t buffer[3];
-	buffer[0] = 0x80 + (chan & 0x0F);
-	buffer[2] = 0;
-	for (note = 0; note < 128; note++) {
-		buffer[1] = note;
-		if (zmops[izmop].note_state[note] > 0)
-			if (!write_rb_midi_event(zmips[iz].rbuffer, buffer, 3))
-				return 0;
-	}
+	__atomic_fetch_or(&all_notes_off_request, 1ULL << izmop, __ATOMIC_RELEASE);
 	return 1;
 }
 
@@ -1804,7 +4250,13 @@ int zmop_send_midi_event(uint8_t iz, uint8_t *event_buffer, int event_size) {
 		fprintf(stderr, "ZynMidiRouter: Bad input port index (%d).\n", iz);
 		return 0;
 	}
-	return write_rb_midi_event(zmops[iz].rbuffer, event_buffer, event_size);
+	// Device removal frees the ring-buffer => hold the mutex while writing
+	int res = 0;
+	pthread_mutex_lock(&zmop_send_mutex);
+	if (zmops[iz].rbuffer)
+		res = write_rb_midi_event(zmops[iz].rbuffer, event_buffer, event_size, router_stats->zmops + iz);
+	pthread_mutex_unlock(&zmop_send_mutex);
+	return res;
 }
 
 int zmop_send_note_off(uint8_t iz, uint8_t chan, uint8_t note, uint8_t vel) {
@@ -1884,23 +4336,23 @@ int ctrlfb_send_program_change(uint8_t chan, uint8_t prgm) {
 //-----------------------------------------------------------------------------
 
 int dev_send_midi_event(uint8_t idev, uint8_t *event_buffer, int event_size) {
-	zmop_send_midi_event(ZMOP_DEV0 + idev, event_buffer, event_size);
+	zmop_send_midi_event(zmop_get_dev_index(idev), event_buffer, event_size);
 }
 
 int dev_send_note_off(uint8_t idev, uint8_t chan, uint8_t note, uint8_t vel) {
-	zmop_send_note_off(ZMOP_DEV0 + idev, chan, note, vel);
+	zmop_send_note_off(zmop_get_dev_index(idev), chan, note, vel);
 }
 
 int dev_send_note_on(uint8_t idev, uint8_t chan, uint8_t note, uint8_t vel) {
-	zmop_send_note_on(ZMOP_DEV0 + idev, chan, note, vel);
+	zmop_send_note_on(zmop_get_dev_index(idev), chan, note, vel);
 }
 
 int dev_send_ccontrol_change(uint8_t idev, uint8_t chan, uint8_t ctrl, uint8_t val) {
-	zmop_send_ccontrol_change(ZMOP_DEV0 + idev, chan, ctrl, val);
+	zmop_send_ccontrol_change(zmop_get_dev_index(idev), chan, ctrl, val);
 }
 
 int dev_send_program_change(uint8_t idev, uint8_t chan, uint8_t prgm) {
-	zmop_send_program_change(ZMOP_DEV0 + idev, chan, prgm);
+	zmop_send_program_change(zmop_get_dev_index(idev), chan, prgm);
 }
 
 //-----------------------------------------------------------------------------
@@ -1918,17 +4370,39 @@ int init_zynmidi_buffer() {
 		fprintf(stderr, "ZynMidiRouter: Error locking memory for zynmidi ring-buffer.\n");
 		return 0;
 	}
+	zynmidi_record_buffer = jack_ringbuffer_create(ZYNMIDI_RECORD_BUFFER_SIZE);
+	if(!zynmidi_record_buffer) {
+		fprintf(stderr, "ZynMidiRouter: Error creating zynmidi record ring-buffer.\n");
+		return 0;
+	}
+	if (jack_ringbuffer_mlock(zynmidi_record_buffer)) {
+		fprintf(stderr, "ZynMidiRouter: Error locking memory for zynmidi record ring-buffer.\n");
+		return 0;
+	}
+	zynmidi_internal_buffer = jack_ringbuffer_create(ZYNMIDI_INTERNAL_BUFFER_SIZE);
+	if(!zynmidi_internal_buffer) {
+		fprintf(stderr, "ZynMidiRouter: Error creating zynmidi internal ring-buffer.\n");
+		return 0;
+	}
+	if (jack_ringbuffer_mlock(zynmidi_internal_buffer)) {
+		fprintf(stderr, "ZynMidiRouter: Error locking memory for zynmidi internal ring-buffer.\n");
+		return 0;
+	}
 	return 1;
 }
 
 int end_zynmidi_buffer() {
 	jack_ringbuffer_free(zynmidi_buffer);
+	jack_ringbuffer_free(zynmidi_record_buffer);
+	jack_ringbuffer_free(zynmidi_internal_buffer);
 	return 1;
 }
 
 int write_zynmidi(uint32_t ev) {
-	if (jack_ringbuffer_write_space(zynmidi_buffer) < 4)
+	if (jack_ringbuffer_write_space(zynmidi_buffer) < 4) {
+		__atomic_fetch_add(&router_stats->ui_overflows, 1, __ATOMIC_RELAXED);
 		return 0;
+	}
 	if (jack_ringbuffer_write(zynmidi_buffer, (uint8_t*)&ev, 4) != 4)
 		return 0;
 	return 1;
@@ -1960,28 +4434,129 @@ int get_zynmidi_num_pending() {
 	return jack_ringbuffer_read_space(zynmidi_buffer) >> 2;
 }
 
+void set_zynmidi_mode(int mode) {
+	router_config_begin();
+	zynmidi_mode = mode & (ZYNMIDI_MODE_WORDS | ZYNMIDI_MODE_RECORDS);
+	router_config_commit();
+}
+
+int get_zynmidi_mode() {
+	return zynmidi_mode;
+}
+
+// Write a record at once, so the UI never reads it incomplete
+int write_zynmidi_record(uint8_t type, uint8_t izmip, uint32_t time, uint8_t *data, int size) {
+	if (size <= 0 || size > 0xFFFF)
+		return 0;
+	struct zynmidi_record_st hdr;
+	hdr.type = type;
+	hdr.izmip = izmip;
+	hdr.size = size;
+	hdr.time = time;
+	size_t rsize = sizeof(hdr) + size;
+	if (jack_ringbuffer_write_space(zynmidi_record_buffer) < rsize) {
+		__atomic_fetch_add(&router_stats->ui_overflows, 1, __ATOMIC_RELAXED);
+		return 0;
+	}
+	jack_ringbuffer_data_t vec[2];
+	jack_ringbuffer_get_write_vector(zynmidi_record_buffer, vec);
+	rb_vector_write(vec, 0, &hdr, sizeof(hdr));
+	rb_vector_write(vec, sizeof(hdr), data, size);
+	jack_ringbuffer_write_advance(zynmidi_record_buffer, rsize);
+	return 1;
+}
+
+// Read as many complete records as fit in buffer. Returns the number of bytes read, or
+// minus the size needed by the next record if it doesn't fit in buffer (nothing is read).
+int read_zynmidi_records(uint8_t *buffer, int size) {
+	struct zynmidi_record_st hdr;
+	jack_ringbuffer_data_t vec[2];
+	jack_ringbuffer_get_read_vector(zynmidi_record_buffer, vec);
+	size_t len = vec[0].len + vec[1].len;
+	size_t max = size > 0 ? (size_t)size : 0;
+	size_t pos = 0;
+	while (pos + sizeof(hdr) <= len) {
+		rb_vector_read(vec, pos, &hdr, sizeof(hdr));
+		size_t rsize = sizeof(hdr) + hdr.size;
+		if (pos + rsize > len)
+			break;
+		if (pos + rsize > max) {
+			if (pos == 0)
+				return -(int)rsize;
+			break;
+		}
+		pos += rsize;
+	}
+	if (pos > 0) {
+		rb_vector_read(vec, 0, buffer, pos);
+		jack_ringbuffer_read_advance(zynmidi_record_buffer, pos);
+	}
+	return (int)pos;
+}
+
+// Returns the number of bytes pending in the record buffer
+int get_zynmidi_records_pending() {
+	return jack_ringbuffer_read_space(zynmidi_record_buffer);
+}
+
 //-----------------------------------------------------------------------------
 // MIDI Internal Output: Send Functions => UI
 //-----------------------------------------------------------------------------
 
+struct zynmidi_internal_st {
+	uint32_t ev;					// 4-bytes word, as sent to UI
+	uint32_t size;					// MIDI message size
+	jack_nframes_t time;			// Jack frame time
+};
+
+// Send internal event to the UI channels enabled by zynmidi mode.
+// UI rings are single-producer (jack process), so the event is queued & forwarded by jack process.
+int write_zynmidi_internal(uint32_t ev, int size) {
+	if (!zynmidi_mode)
+		return 1;
+	struct zynmidi_internal_st iev = {ev, size, jack_frame_time(jack_client)};
+	int res = 0;
+	pthread_mutex_lock(&zynmidi_internal_mutex);
+	if (jack_ringbuffer_write_space(zynmidi_internal_buffer) >= sizeof(iev))
+		res = (jack_ringbuffer_write(zynmidi_internal_buffer, (char *)&iev, sizeof(iev)) == sizeof(iev));
+	pthread_mutex_unlock(&zynmidi_internal_mutex);
+	if (!res)
+		__atomic_fetch_add(&router_stats->ui_overflows, 1, __ATOMIC_RELAXED);
+	return res;
+}
+
+// Forward queued internal events to the UI channels. Called from jack process.
+void forward_zynmidi_internal(struct router_config_st * cfg) {
+	struct zynmidi_internal_st iev;
+	while (jack_ringbuffer_read_space(zynmidi_internal_buffer) >= sizeof(iev)) {
+		jack_ringbuffer_read(zynmidi_internal_buffer, (char *)&iev, sizeof(iev));
+		if (cfg->zynmidi_mode & ZYNMIDI_MODE_RECORDS) {
+			uint8_t data[3] = {(iev.ev >> 16) & 0xFF, (iev.ev >> 8) & 0xFF, iev.ev & 0xFF};
+			write_zynmidi_record(ZYNMIDI_REC_INTERNAL, 0xFF, iev.time, data, iev.size);
+		}
+		if (cfg->zynmidi_mode & ZYNMIDI_MODE_WORDS)
+			write_zynmidi(iev.ev);
+	}
+}
+
 int write_zynmidi_note_on(uint8_t chan, uint8_t num, uint8_t val) {
 	uint32_t ev = ((0xFFu << 24) | (0x90 | (chan & 0x0F)) << 16) | (num << 8) | val;
-	return write_zynmidi(ev);
+	return write_zynmidi_internal(ev, 3);
 }
 
 int write_zynmidi_note_off(uint8_t chan, uint8_t num, uint8_t val) {
 	uint32_t ev = ((0xFFu << 24) | (0x80 | (chan & 0x0F)) << 16) | (num << 8) | val;
-	return write_zynmidi(ev);
+	return write_zynmidi_internal(ev, 3);
 }
 
 int write_zynmidi_ccontrol_change(uint8_t chan, uint8_t num, uint8_t val) {
 	uint32_t ev = ((0xFFu << 24) | (0xB0 | (chan & 0x0F)) << 16) | (num << 8) | val;
-	return write_zynmidi(ev);
+	return write_zynmidi_internal(ev, 3);
 }
 
 int write_zynmidi_program_change(uint8_t chan, uint8_t num) {
 	uint32_t ev = ((0xFFu << 24) | (0xC0 | (chan & 0x0F)) << 16) | (num << 8);
-	return write_zynmidi(ev);
+	return write_zynmidi_internal(ev, 2);
 }
 
 //-----------------------------------------------------------------------------
@@ -131,6 +131,25 @@ typedef struct midi_filter_st {
 	midi_event_t event_map[8][16][128];
 } midi_filter_t;
 
+// Compiled MIDI filter, as seen by jack process. Only rows (event type, MIDI channel) having
+// rules are stored, with packed 4-byte entries. Rows without rules pass all events through,
+// so filtering them is a single bit test. Most setups have no rules at all.
+typedef struct midi_filter_entry_st {
+	int8_t type;						// THRU_EVENT, IGNORE_EVENT or event type to map to
+	uint8_t chan;
+	uint8_t num;
+	uint8_t reserved;
+} midi_filter_entry_t;
+
+typedef struct midi_filter_rules_st {
+	uint16_t has_rules[8];				// Bitmap of MIDI channels having rules, by event type & 0x7
+	uint8_t row[8][16];					// Index in rows, for each (event type & 0x7, MIDI channel) having rules
+	int n_rows;
+	midi_filter_entry_t rows[8 * 16][128];
+} midi_filter_rules_t;
+
+void midi_filter_compile(midi_filter_t * filter, midi_filter_rules_t * rules);
+
 //MIDI Filter Core functions
 void set_midi_filter_event_map_st(midi_event_t *ev_from, midi_event_t *ev_to);
 void set_midi_filter_event_map(midi_event_type type_from, uint8_t chan_from, uint8_t num_from, midi_event_type type_to, uint8_t chan_to, uint8_t num_to);
@@ -141,6 +160,10 @@ midi_event_t *get_midi_filter_event_map(midi_event_type type_from, uint8_t chan_
 void del_midi_filter_event_map_st(midi_event_t *ev_filter);
 void del_midi_filter_event_map(midi_event_type type_from, uint8_t chan_from, uint8_t num_from);
 void reset_midi_filter_event_map();
+// Range rules => map num_first-num_last to num_to_first... Rejected if targets go beyond 127
+void set_midi_filter_event_range_map(midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last, midi_event_type type_to, uint8_t chan_to, uint8_t num_to_first);
+void set_midi_filter_event_range_ignore(midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last);
+void del_midi_filter_event_range_map(midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last);
 
 //MIDI Filter Mapping
 void set_midi_filter_cc_map(uint8_t chan_from, uint8_t cc_from, uint8_t chan_to, uint8_t cc_to);
@@ -148,6 +171,26 @@ void set_midi_filter_cc_ignore(uint8_t chan, uint8_t cc_from);
 uint8_t get_midi_filter_cc_map(uint8_t chan, uint8_t cc_from);
 void del_midi_filter_cc_map(uint8_t chan, uint8_t cc_from);
 void reset_midi_filter_cc_map();
+void set_midi_filter_cc_range_map(uint8_t chan_from, uint8_t cc_first, uint8_t cc_last, uint8_t chan_to, uint8_t cc_to_first);
+void del_midi_filter_cc_range_map(uint8_t chan_from, uint8_t cc_first, uint8_t cc_last);
+
+//MIDI Filter by input port => By default, input ports use the global filter. Ports share
+//filters, copy-on-write: editing a shared filter gives the port its own copy.
+#define MIDI_FILTER_GLOBAL 0
+#define MAX_NUM_MIDI_FILTERS 8				// Global filter + filters owned by input ports
+
+int zmip_set_midi_filter_event_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from, midi_event_type type_to, uint8_t chan_to, uint8_t num_to);
+int zmip_set_midi_filter_event_ignore(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from);
+midi_event_t *zmip_get_midi_filter_event_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from);
+int zmip_del_midi_filter_event_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_from);
+int zmip_set_midi_filter_event_range_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last, midi_event_type type_to, uint8_t chan_to, uint8_t num_to_first);
+int zmip_del_midi_filter_event_range_map(int iz, midi_event_type type_from, uint8_t chan_from, uint8_t num_first, uint8_t num_last);
+int zmip_set_midi_filter_cc_map(int iz, uint8_t chan_from, uint8_t cc_from, uint8_t chan_to, uint8_t cc_to);
+int zmip_set_midi_filter_cc_ignore(int iz, uint8_t chan_from, uint8_t cc_from);
+int zmip_del_midi_filter_cc_map(int iz, uint8_t chan_from, uint8_t cc_from);
+int zmip_share_midi_filter(int iz, int iz_src);		// Use the same filter than iz_src
+int zmip_reset_midi_filter(int iz);					// Back to global filter
+int zmip_get_midi_filter(int iz);					// Index of the filter used by iz. MIDI_FILTER_GLOBAL if global.
 
 //-----------------------------------------------------------------------------
 // MIDI Input Ports (ZMIPs)
@@ -182,8 +225,10 @@ void reset_midi_filter_cc_map();
 #define ZMIP_CTRL 26			// Engine's controller feedback (setBfree, others?) => It's hardcoded in chain_manager. Update if this number changes!!
 #define ZMIP_FAKE_INT 27		// BUFFER: Internal MIDI (to ALL zmops => MUST BE CHANGED!!) => Used by zyncoder, zynaptik (CV/Gate), zyntof, etc.
 #define ZMIP_FAKE_UI 28			// BUFFER: MIDI from UI (to Chain zmops)
-#define MAX_NUM_ZMIPS 29
-#define NUM_ZMIP_DEVS 24
+#define ZMIP_DEV_EXT0 29		// Extra device slots => Not registered at init. Use zmip_add_dev.
+#define NUM_ZMIP_DEVS 24		// Device slots registered at init (ZMIP_DEV0-23)
+#define NUM_ZMIP_DEVS_EXT 21	// Extra device slots (ZMIP_DEV_EXT0...)
+#define MAX_NUM_ZMIPS (ZMIP_DEV_EXT0 + NUM_ZMIP_DEVS_EXT)
 
 #define FLAG_ZMIP_UI 1
 #define FLAG_ZMIP_FILTER 1
@@ -198,18 +243,47 @@ void reset_midi_filter_cc_map();
 #define ZMIP_INT_FLAGS (FLAG_ZMIP_UI|FLAG_ZMIP_FILTER|FLAG_ZMIP_DIRECTIN)
 #define ZMIP_UI_FLAGS (FLAG_ZMIP_DIRECTIN)
 
-// Structure describing a MIDI input
+// Direct inputs have several lanes, so producer threads never share a ring-buffer. Threads lease
+// a lane on first use and release it when exiting. Lane 0 is shared by threads that couldn't lease
+// a lane, serialized with a mutex. Jack process merges lanes by timestamp.
+#define NUM_ZMIP_LANES 8
+
+// Direct input lane => single-producer ring buffer
+struct zmip_lane_st {
+	jack_ringbuffer_t * rbuffer;	// Ring buffer
+	uint8_t * wrap_buffer;			// Records wrapped around the ring buffer end are copied here
+	uintptr_t owner;				// Producer thread leasing the lane, 0 if free. Lane 0 is never leased.
+	jack_midi_event_t event;		// Next event from this lane (jack process only)
+	size_t rb_pending;				// Size of the record holding the event, read in place (jack process only)
+};
+
+// Staging arena of a ZMIP => the largest non-SysEx message is 3 bytes
+#define ZMIP_STAGE_SIZE 4
+
+// Structure describing a MIDI input. Flags are the writer side: jack process uses the config snapshot.
 struct zmip_st {
+	// Jack process state => every event
 	jack_port_t *jport;				// jack midi port
 	void * buffer;					// Pointer to the jack midi buffer
-	jack_ringbuffer_t * rbuffer;	// Direct input ring buffer => Used when DIRECTIN flag is set
-
-	uint32_t flags;					// Bitwise flags influencing input behaviour
-
 	uint32_t event_count;			// Quantity of events in input event queue (not fake queues)
 	uint32_t next_event;			// Index of the next event to be processed (not fake queues)
 	jack_midi_event_t event;		// Event currently being processed
+	struct zmip_lane_st * lanes;	// Direct input lanes => Used when DIRECTIN flag is set
+	uint8_t sysex_state;			// SysEx reassembly state (jack process only)
+	uint8_t stage[ZMIP_STAGE_SIZE];	// Private copy of the short event being processed => filter & CC modes modify it
+
+	// Jack process state => direct inputs & splitted SysEx only
+	struct zmip_lane_st * lane;		// Lane holding the event currently being processed (jack process only)
+	struct sysex_buffer_st * sysex;	// SysEx reassembly buffer, taken from pool while receiving a splitted message
 
+	// Writer side => cold
+	uint32_t flags;					// Bitwise flags influencing input behaviour
+	int n_connections;				// Quantity of jack connections (used for optimisation)
+	int registered;					// Slot is in use => zmip_init / zmip_end
+	int midi_filter;				// Index of the MIDI filter used by this port (shared, copy-on-write)
+	uint64_t (*note_owners)[128];	// Note ownership by channel & note (ACTI zmips only, allocated on demand)
+
+	// Jack process state => CC events only
 	uint8_t ctrl_mode[16][128];				// Controller mode for all 128 CCs x 16 chans
 	uint8_t ctrl_relmode_count[16][128];	// Counter array used for mode auto-detection
 	uint8_t last_ctrl_val[16][128];			// Last CC value tracked for each CC x 16 chans
@@ -218,7 +292,17 @@ struct zmip_st {
 // MIDI Input port (ZMIPs) management
 int zmip_init(int iz, char *name, uint32_t flags);
 int zmip_end(int iz);
+int zmip_alloc_note_owners(int iz);
+int zmip_get_lane(int iz);
+void zmip_release_lanes(void * arg);
 int zmip_get_num_devs();
+// Device slots registry => Slot index is a stable handle while registered. Device number is
+// the index among device slots: 0-23 => ZMIP_DEV0-23, next ones => ZMIP_DEV_EXT0...
+int zmip_get_max_devs();
+int zmip_get_dev_index(int idev);			// Slot index of device number, -1 if out of range
+int zmip_is_dev(int iz);
+int zmip_add_dev(char *name);				// Register first free device slot, routed to chains. Returns slot index or -1. NULL name => "devN_in"
+int zmip_remove_dev(int iz);				// Unregister device slot, after jack process stopped using it. If it doesn't stop, buffers are leaked, not freed
 // Flag management
 int zmip_set_flags(int iz, uint32_t flags);
 uint32_t zmip_get_flags(int iz);
@@ -277,9 +361,11 @@ int zmip_set_route_chains(int iz, int route);			// Route/un-route a MIDI input p
 #define ZMOP_DEV21 40
 #define ZMOP_DEV22 41
 #define ZMOP_DEV23 42
-#define MAX_NUM_ZMOPS 43
+#define ZMOP_DEV_EXT0 43			// Extra device slots => Not registered at init. Use zmop_add_dev.
 #define NUM_ZMOP_CHAINS 17
-#define NUM_ZMOP_DEVS 24
+#define NUM_ZMOP_DEVS 24			// Device slots registered at init (ZMOP_DEV0-23)
+#define NUM_ZMOP_DEVS_EXT 21		// Extra device slots (ZMOP_DEV_EXT0...). zmop bitmasks limit MAX_NUM_ZMOPS to 64!
+#define MAX_NUM_ZMOPS (ZMOP_DEV_EXT0 + NUM_ZMOP_DEVS_EXT)
 
 #define FLAG_ZMOP_DROPPC 1
 #define FLAG_ZMOP_DROPCC 2
@@ -294,12 +380,23 @@ int zmip_set_route_chains(int iz, int route);			// Route/un-route a MIDI input p
 //#define ZMOP_CHAIN_FLAGS (FLAG_ZMOP_TUNING|FLAG_ZMOP_NOTERANGE|FLAG_ZMOP_DROPSYS|FLAG_ZMOP_DROPSYSEX|FLAG_ZMOP_CHAN_TRANSFILTER|FLAG_ZMOP_DIRECTOUT)
 #define ZMOP_CHAIN_FLAGS (FLAG_ZMOP_TUNING|FLAG_ZMOP_NOTERANGE|FLAG_ZMOP_DROPSYSEX|FLAG_ZMOP_CHAN_TRANSFILTER|FLAG_ZMOP_DIRECTOUT)
 
-// Structure describing a MIDI output
+// Structure describing a MIDI output. Config fields are the writer side: jack process uses the config snapshot
+// (zmop_config_st) instead.
 struct zmop_st {
-	jack_port_t *jport;				// jack midi port
+	// Jack process state => every event
 	void * buffer;					// pointer to jack midi output buffer
+	jack_nframes_t last_time;		// Time of last event written to buffer in current cycle (jack process only)
+	int live;						// Buffer was acquired & cleared in last cycle (jack process only)
+	uint16_t note_chans;					// Bitmask of MIDI channels having held notes (jack process only)
+	uint16_t last_pb_val[16];				// Last pitch-bending value. Do we need multi-channel tracking for MPE?
+	jack_port_t *jport;				// jack midi port
 	jack_ringbuffer_t * rbuffer;	// direct output ring buffer (optional)
 
+	// Jack process state => note events only
+	uint64_t note_bits[16][2];				// Held notes bitset for each MIDI channel (jack process only)
+	int8_t note_transpose[128];				// Note transpose array for managing pressed notes across transpose changes.
+
+	// Writer side => cold
 	int midi_chan;							// Single MIDI channel. -1 for using channel translation map only.
 	int midi_chans[16];						// MIDI channel translation map (-1 to disable a MIDI channel)
 	int route_from_zmips[MAX_NUM_ZMIPS];	// Flags indicating which inputs to route to this output
@@ -310,18 +407,28 @@ struct zmop_st {
 	int8_t transpose_octave;				// Transpose coarse => octave
 	int8_t transpose_semitone;				// Transpose fine => semitone
 
-	uint8_t note_state[128];				// Note state array for managing pressed notes across active chain changes.
-	int8_t note_transpose[128];				// Note transpose array for managing pressed notes across transpose changes.
-	uint16_t last_pb_val[16];				// Last pitch-bending value. Do we need multi-channel tracking for MPE?
-
 	int n_connections;				// Quantity of jack connections (used for optimisation)
+	int registered;					// Slot is in use => zmop_init / zmop_end
 };
 
+// Held notes tracking, for managing pressed notes across active chain changes & all-notes-off.
+// These are called from jack process!!
+void zmop_note_on(struct zmop_st * zmop, uint8_t chan, uint8_t note);
+void zmop_note_off(struct zmop_st * zmop, uint8_t chan, uint8_t note);
+int zmop_note_held(struct zmop_st * zmop, uint8_t note);
+int zmop_get_num_held_notes(int iz);
+
 // MIDI output port (ZMOPs) management
 int zmop_init(int iz, char *name, uint32_t flags);
 int zmop_end(int iz);
 int zmop_get_num_chains();
 int zmop_get_num_devs();
+// Device slots registry => See zmip device slots
+int zmop_get_max_devs();
+int zmop_get_dev_index(int idev);			// Slot index of device number, -1 if out of range
+int zmop_is_dev(int iz);
+int zmop_add_dev(char *name);				// Register first free device slot (direct output). Returns slot index or -1. NULL name => "devN_out"
+int zmop_remove_dev(int iz);				// Unregister device slot, after jack process stopped using it. If it doesn't stop, buffers are leaked, not freed
 // Flag management
 int zmop_set_flags(int iz, uint32_t flags);
 uint32_t zmop_get_flags(int iz);
@@ -353,8 +460,12 @@ int zmop_get_midi_chan_info(int iz, int *buffer);
 int zmop_reset_routes_from(int izmop);
 int zmop_set_route_from(int izmop, int izmip, int route);
 int zmop_get_route_from(int izmop, int izmip);
-int zmop_get_routes_info(int izmop, int *buffer);
-int zmop_get_routes_info_all(int *buffer);
+int zmop_get_routes_info(int izmop, int *buffer);		// Legacy => ZMIP_DEV_EXT0 routes
+int zmop_get_routes_info_all(int *buffer);				// Legacy => ZMIP_DEV_EXT0 x ZMIP_DEV_EXT0 routes
+int zmop_get_routes_info_ext(int izmop, int *buffer, int size);	// Up to size routes. Returns quantity copied.
+int zmop_get_routes_info_all_ext(int *buffer, int size);		// MAX_NUM_ZMOPS x MAX_NUM_ZMIPS routes. Returns quantity copied, -1 if buffer is too small.
+int get_max_num_zmips();
+int get_max_num_zmops();
 // MIDI Note Range & Transpose
 int zmop_set_note_low(int iz, uint8_t nlow);
 int zmop_set_note_high(int iz, uint8_t nhigh);
@@ -372,9 +483,371 @@ int zmop_reset_note_range_transpose(int iz);
 int zmop_reset_cc_route(int iz);
 int zmop_set_cc_route(int iz, uint8_t *cc_route);
 int zmop_get_cc_route(int iz, uint8_t *cc_route);
-// ----------------------------------------------------------------------------
+
+//-----------------------------------------------------------------------------
+// Router Configuration Snapshots
+//-----------------------------------------------------------------------------
+
+// Setters edit the writer side (global settings, MIDI filter, zmip & zmop structs)
+// and publish an immutable snapshot when committing. Jack process reads only the
+// snapshot, picking the last published one at the start of every cycle.
+
+#define NUM_ROUTER_CONFIG_SLOTS 3
+
+// MIDI filter, writer side & compiled tables. A compiled table is shared by all zmips using
+// the filter & by snapshots while unchanged. Each filter has its own compiled slots.
+struct midi_filter_map_st {
+	midi_filter_t filter;				// Writer side rules
+	int refs;							// Quantity of zmips using it. Not counted for global filter.
+	int dirty;							// Changed since last published snapshot
+	midi_filter_rules_t * rules;		// Compiled for last published snapshot
+	midi_filter_rules_t rules_slots[NUM_ROUTER_CONFIG_SLOTS];
+};
+
+// MIDI input configuration, as seen by jack process
+struct zmip_config_st {
+	uint32_t flags;						// Bitwise flags influencing input behaviour
+	int external;						// External source (devices, sequencers, engine feedback) => DROPCC applies
+	midi_filter_rules_t * midi_filter;	// Compiled MIDI filter
+	int n_fanout;						// Quantity of zmops in fan-out list
+	int passthrough;					// Target zmop of a plain device-to-device route, -1 if none
+	uint8_t fanout[MAX_NUM_ZMOPS];		// Routed & connected zmops, in ascending order. Compiled from zmop's routes.
+};
+
+// Status-byte table of a zmop => one entry for each status byte, resolving the fan-out stage
+// (channel translation & filtering, DROP* flags) with a single load. There is a table for
+// events from ACTI zmips and another for the rest. Compiled when configuration is published.
+#define ZMOP_STATUS_DROP 0x01		// Drop always: disabled/not mapped channel, DROPSYSEX
+#define ZMOP_STATUS_ACTI 0x02		// Note-off goes to zmops owning the note, the rest to active zmop only
+#define ZMOP_STATUS_INACTIVE 0x04	// Not the active zmop => only note-off to owned notes
+#define ZMOP_STATUS_DROPCC 0x08		// Drop CC from external sources, if not in CC routes
+#define ZMOP_STATUS_DROPPC 0x10		// Drop program change, except from UI
+#define ZMOP_STATUS_DROPNOTE 0x20	// Drop note on/off, except from UI
+#define ZMOP_STATUS_DROPSYS 0x40	// Drop system message, except from UI
+#define ZMOP_STATUS_NOTE 0x80		// Track note on/off state
+
+struct zmop_status_st {
+	uint8_t status;		// Output status byte, with translated channel
+	uint8_t op;			// ZMOP_STATUS_* flags. 0 => send it.
+};
+
+// Output handler: post-process event and write it to the zmop's jack buffer.
+// Selected from flags when publishing, so jack process doesn't test them for every event.
+struct zmop_config_st;
+typedef void (*zmop_output_handler_t)(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev);
+
+// MIDI output configuration, as seen by jack process. Only the fields used for every
+// routed event => a fan-out of 16 zmops fits in 10 cache lines. Routes from zmips are
+// compiled into zmip's fan-out & CC routes are stored apart (zmop_cc_route).
+struct zmop_config_st {
+	zmop_output_handler_t output;		// Specialized output handler
+	uint32_t flags;
+	int n_connections;
+	int8_t midi_chan;
+	int8_t midi_chans[16];
+	uint8_t note_low;
+	uint8_t note_high;
+	int8_t transpose_octave;
+	int8_t transpose_semitone;
+};
+
+struct router_config_st {
+	int active_chain;
+	int active_midi_chan;
+	int tuning_pitchbend;
+	int midi_master_chan;
+	int midi_system_events;
+	int midi_learning_mode;
+	int zynmidi_mode;
+	int8_t global_transpose;
+	struct zmip_config_st zmips[MAX_NUM_ZMIPS];
+	struct zmop_config_st zmops[MAX_NUM_ZMOPS];
+	int n_active_zmips;					// Quantity of active zmips
+	uint8_t active_zmips[MAX_NUM_ZMIPS];	// Connected jack inputs & direct inputs, in ascending order
+	int n_active_zmops;					// Quantity of active zmops
+	uint8_t active_zmops[MAX_NUM_ZMOPS];	// Connected jack outputs, in ascending order
+	int n_directout_zmops;				// Quantity of direct output zmops
+	uint8_t directout_zmops[MAX_NUM_ZMOPS];	// Registered zmops with direct output ring-buffer, in ascending order
+	uint32_t trace_seq;					// Sequence of the CONFIG trace record, 0 if not tracing
+	uint8_t zmop_cc_route[MAX_NUM_ZMOPS][128];	// CCs routed to zmops. Cold: read only for CC events to DROPCC zmops.
+	struct zmop_status_st zmop_status[MAX_NUM_ZMOPS][2][256];	// Status-byte tables of connected zmops => [izmop][ACTI zmip][status]
+};
+
+// Enclose setters between begin & commit. Nested calls publish a single snapshot.
+void router_config_begin();
+void router_config_commit();
+void publish_router_config();
+// Wait until jack process doesn't use older snapshots. Call it without router_config_mutex!
+int router_config_sync();
 // This is called from jack process!!
-void zmop_push_event(struct zmop_st * zmop, jack_midi_event_t * ev); // Add event to MIDI output port
+struct router_config_st * get_router_config();
+
+//-----------------------------------------------------------------------------
+// SysEx Reassembly
+//-----------------------------------------------------------------------------
+
+// SysEx messages splitted in several events, maybe across several periods, are
+// reassembled per zmip using buffers from a preallocated & locked pool.
+
+#define SYSEX_POOL_SIZE 4
+#define SYSEX_BUFFER_SIZE 32768
+
+#define SYSEX_IDLE 0			// Not receiving SysEx
+#define SYSEX_RECEIVING 1		// Receiving splitted SysEx into a buffer
+#define SYSEX_SKIPPING 2		// Discarding rest of SysEx (oversize or no free buffer)
+#define SYSEX_COMPLETE 3		// Reassembled SysEx being processed. Buffer is released after processing.
+
+struct sysex_buffer_st {
+	size_t size;
+	uint8_t data[SYSEX_BUFFER_SIZE];
+};
+
+struct sysex_stats_st {
+	uint32_t completed;		// Reassembled messages
+	uint32_t aborted;		// Messages interrupted by another status byte & stray data bytes
+	uint32_t oversize;		// Messages bigger than SYSEX_BUFFER_SIZE
+	uint32_t no_buffer;		// Messages discarded because the pool was exhausted
+};
+
+int init_sysex_pool();
+int end_sysex_pool();
+// These are called from jack process!!
+struct sysex_buffer_st * sysex_pool_acquire();
+void sysex_pool_release(struct sysex_buffer_st * sxb);
+int zmip_sysex_reassemble(struct zmip_st * zmip, jack_midi_event_t * ev);
+void zmip_sysex_reset(struct zmip_st * zmip);
+
+// SysEx reassembly metrics
+uint32_t get_sysex_num_completed();
+uint32_t get_sysex_num_aborted();
+uint32_t get_sysex_num_oversize();
+uint32_t get_sysex_num_no_buffer();
+
+//-----------------------------------------------------------------------------
+// Router Statistics
+//-----------------------------------------------------------------------------
+
+// Counters are published in a shared memory segment, so monitoring tools (zyncore-top)
+// can map it read-only, without calling into the library. Jack process increments them
+// in place. Counters are free-running & wrap around => readers compute rates from deltas.
+
+#define ZYNMIDI_STATS_SHM_NAME "/zynmidirouter_stats"
+#define ZYNMIDI_STATS_VERSION 2
+#define ZYNMIDI_STATS_NAME_SIZE 32
+
+typedef enum {
+	ZYNMIDI_DROP_FILTER = 0,		// zmip: Ignored by MIDI filter
+	ZYNMIDI_DROP_UNROUTED,			// zmip: Not sent to any zmop
+	ZYNMIDI_DROP_RING_FULL,			// zmip/zmop: Direct send ring-buffer is full
+	ZYNMIDI_DROP_CC,				// zmop: DROPCC flag
+	ZYNMIDI_DROP_PC,				// zmop: DROPPC flag
+	ZYNMIDI_DROP_NOTE,				// zmop: DROPNOTE flag
+	ZYNMIDI_DROP_NOTERANGE,			// zmop: Note out of range, or transposed out of range
+	ZYNMIDI_DROP_OUTPUT_FULL,		// zmop: Jack output buffer is full
+	ZYNMIDI_NUM_DROPS
+} zynmidi_drop_reason;
+
+struct zynmidi_port_stats_st {
+	char name[ZYNMIDI_STATS_NAME_SIZE];		// Port name. Empty if port is not registered.
+	uint32_t events;						// Events received (zmip) or sent (zmop)
+	uint32_t drops[ZYNMIDI_NUM_DROPS];		// Dropped events by reason
+};
+
+struct zynmidi_stats_st {
+	uint32_t version;						// ZYNMIDI_STATS_VERSION
+	uint32_t size;							// sizeof(struct zynmidi_stats_st)
+	uint32_t num_zmips;
+	uint32_t num_zmops;
+	uint32_t sample_rate;
+	uint32_t buffer_size;
+	uint32_t cycles;						// Jack process cycles
+	uint32_t ui_overflows;					// Events lost because UI buffers were full
+	struct sysex_stats_st sysex;			// SysEx reassembly metrics
+	struct zynmidi_port_stats_st zmips[MAX_NUM_ZMIPS];
+	struct zynmidi_port_stats_st zmops[MAX_NUM_ZMOPS];
+};
+
+extern struct zynmidi_stats_st * router_stats;	// Never NULL => default to private memory if shm is not available
+extern const char * router_stats_shm_name;		// Set to NULL before init for private statistics (offline tools)
+
+int init_router_stats();
+int end_router_stats();
+void router_stats_set_name(struct zynmidi_port_stats_st * port_stats, const char * name);
+
+//-----------------------------------------------------------------------------
+// Jack Process Profiling
+//-----------------------------------------------------------------------------
+
+// When enabled, jack process measures the wall time of each cycle & its phases,
+// recording them into fixed-bucket histograms. Last bucket counts overflows.
+// Jack process is the only writer: readers get a consistent copy (seqlock) and
+// reset is applied by jack process at the start of next cycle.
+
+#define ZYNMIDI_PROF_NUM_BUCKETS 256
+#define ZYNMIDI_PROF_TIME_BUCKET_NS 1000		// Phase time histograms => 1us buckets
+#define ZYNMIDI_PROF_PERIOD_BUCKET_NS 16000		// Cycle interval histogram => 16us buckets
+
+typedef enum {
+	ZYNMIDI_PROF_TOTAL = 0,			// Whole jack process callback (ns)
+	ZYNMIDI_PROF_SETUP,				// Buffer setup: config snapshot, output buffers, all-notes-off, input scheduling (ns)
+	ZYNMIDI_PROF_DISPATCH,			// Merge & dispatch of input events (ns)
+	ZYNMIDI_PROF_FLUSH,				// Direct-out ring-buffers flush (ns)
+	ZYNMIDI_PROF_PERIOD,			// Interval between consecutive cycles (ns)
+	ZYNMIDI_PROF_EVENTS,			// Input events per cycle (1 event per bucket)
+	ZYNMIDI_PROF_NUM_HISTOGRAMS
+} zynmidi_prof_histogram;
+
+struct zynmidi_histogram_st {
+	uint32_t bucket_width;			// Bucket width in ns (events for ZYNMIDI_PROF_EVENTS)
+	uint32_t count;					// Recorded samples
+	uint64_t sum;					// Sum of samples
+	uint32_t max;					// Worst case
+	uint64_t max_time_us;			// Monotonic clock time of the worst case (us)
+	jack_nframes_t max_frame;		// Jack frame time of the cycle with the worst case
+	uint32_t buckets[ZYNMIDI_PROF_NUM_BUCKETS];
+};
+
+struct zynmidi_profile_st {
+	uint32_t seq;					// Odd while jack process is updating
+	uint32_t sample_rate;
+	jack_nframes_t nframes;			// Period length (frames) of the last cycle
+	uint32_t period_ns;				// Nominal period length (ns) of the last cycle
+	struct zynmidi_histogram_st histograms[ZYNMIDI_PROF_NUM_HISTOGRAMS];
+};
+
+void init_router_profile();
+void set_router_profiling(int enable);		// Enabling resets the profile
+int get_router_profiling();
+void reset_router_profile();				// Applied by jack process at next profiled cycle
+int get_router_profile(struct zynmidi_profile_st * profile);	// Copy consistent snapshot. Returns 0 if jack process kept it busy.
+// Helpers for ctypes. Each call takes a fresh snapshot.
+int get_router_profile_histogram(int ih, uint32_t * buckets, int n);
+uint32_t get_router_profile_bucket_width(int ih);
+uint32_t get_router_profile_count(int ih);
+double get_router_profile_avg(int ih);
+uint32_t get_router_profile_max(int ih);
+uint64_t get_router_profile_max_time(int ih);
+uint32_t get_router_profile_period(); // Nominal period length in ns
+
+//-----------------------------------------------------------------------------
+// RT Memory
+//-----------------------------------------------------------------------------
+// Opt-in mode locking into RAM & prefaulting the memory used by jack process, so the
+// first busy cycle after a long idle period doesn't page-fault. Regions are registered
+// when allocated & reported at init. Leaving LOCKALL mode only unlocks the whole process
+// (munlockall) if nothing else had locked memory before our mlockall. Otherwise the host
+// or another library may rely on it, so the process is left locked.
+
+#define ZYNMIDI_RT_MEMORY_OFF 0
+#define ZYNMIDI_RT_MEMORY_LOCK 1			// Lock & prefault regions used by jack process
+#define ZYNMIDI_RT_MEMORY_LOCKALL 2			// Also lock the whole process, current & future pages (mlockall)
+
+#define ZYNMIDI_RT_MEMORY_MAX_REGIONS 256
+
+struct zynmidi_rt_region_st {
+	const char * name;
+	void * addr;
+	size_t size;
+	int locked;
+	int always_locked;				// Locked by its owner, whatever the RT memory mode => never unlocked here
+};
+
+void init_router_rt_memory();
+void end_router_rt_memory();
+int set_router_rt_memory(int mode);			// Call before init_zynmidirouter. Later calls are applied at once.
+int get_router_rt_memory();
+size_t get_router_rt_memory_locked();		// Locked bytes, in registered regions
+void router_rt_memory_add(const char * name, void * addr, size_t size);		// Not for jack process!
+void router_rt_memory_add_locked(const char * name, void * addr, size_t size);	// Region already locked by its owner
+void router_rt_memory_remove(void * addr);
+void router_rt_memory_report();
+
+//-----------------------------------------------------------------------------
+// MIDI Trace Capture
+//-----------------------------------------------------------------------------
+
+// Record router inputs to a binary file, for deterministic offline replay:
+// input events as seen by the dispatcher (per zmip, frame-stamped, before any
+// processing), all-notes-off requests and configuration changes. Jack process
+// writes records to a ring-buffer, drained to file by a low-priority thread.
+// Configuration is written by setters when published (CONFIG), and jack process
+// records the cycle where each configuration is applied (CONFIG_APPLY).
+// Direct-out ring-buffer events (FLAG_ZMOP_DIRECTOUT) are not routed, so they are not recorded.
+// Runtime state at trace start: held notes of each zmop are recorded (NOTES), so note-offs &
+// all-notes-off replay right. Note owners of ACTI zmips, unfinished SysEx messages and CC
+// auto-mode detection are not recorded => replay starts them from reset state.
+
+#define ZYNMIDI_TRACE_MAGIC "ZMTR"
+#define ZYNMIDI_TRACE_VERSION 2
+#define ZYNMIDI_TRACE_RB_SIZE (1 << 20)
+#define ZYNMIDI_TRACE_POLL_US 20000
+
+typedef enum {
+	ZYNMIDI_TRACE_CYCLE = 0,		// time = cycle frame time, data = nframes (uint32_t)
+	ZYNMIDI_TRACE_EVENT,			// izmip, time = frame offset in cycle, data = MIDI event
+	ZYNMIDI_TRACE_ALL_NOTES_OFF,	// data = zmops mask (uint64_t), processed at cycle start
+	ZYNMIDI_TRACE_CONFIG,			// time = config seq, data = struct zynmidi_trace_config_st
+	ZYNMIDI_TRACE_FILTER,			// time = config seq, izmip = filter index * 8 + event type index, data = event_map[type]
+	ZYNMIDI_TRACE_CONFIG_APPLY,		// time = config seq applied from this cycle
+	ZYNMIDI_TRACE_LOST,				// time = quantity of records lost since last LOST record (ring-buffer full)
+	ZYNMIDI_TRACE_NOTES				// izmip = zmop index, data = held notes (zmop_st.note_bits) at trace start
+} zynmidi_trace_record_type;
+
+struct zynmidi_trace_header_st {
+	char magic[4];
+	uint32_t version;
+	uint32_t sample_rate;
+	uint32_t buffer_size;
+	uint32_t num_zmips;
+	uint32_t num_zmops;
+	uint32_t config_size;			// sizeof(struct zynmidi_trace_config_st)
+};
+
+struct zynmidi_trace_record_st {
+	uint32_t time;
+	uint16_t size;					// Data bytes following the record header
+	uint8_t type;
+	uint8_t izmip;
+};
+
+// Writer side of the router configuration, as seen by publish_router_config
+struct zynmidi_trace_zmop_config_st {
+	uint32_t flags;
+	int32_t midi_chan;
+	int32_t midi_chans[16];
+	uint8_t route_from_zmips[MAX_NUM_ZMIPS];
+	uint8_t cc_route[128];
+	uint8_t note_low;
+	uint8_t note_high;
+	int8_t transpose_octave;
+	int8_t transpose_semitone;
+	int32_t n_connections;
+};
+
+struct zynmidi_trace_config_st {
+	int32_t active_chain;
+	int32_t active_midi_chan;
+	int32_t tuning_pitchbend;
+	int32_t midi_master_chan;
+	int32_t midi_system_events;
+	int32_t midi_learning_mode;
+	int32_t zynmidi_mode;
+	int32_t global_transpose;
+	uint32_t zmip_flags[MAX_NUM_ZMIPS];
+	int32_t zmip_connections[MAX_NUM_ZMIPS];
+	uint8_t zmip_midi_filter[MAX_NUM_ZMIPS];
+	struct zynmidi_trace_zmop_config_st zmops[MAX_NUM_ZMOPS];
+};
+
+void router_trace_write_rt(uint8_t type, uint8_t izmip, uint32_t time, const void * data, size_t size);	// Jack process only!
+uint32_t router_trace_write_config(uint32_t filters_changed);	// Bitmask of changed filters. Returns config seq.
+int start_router_trace(const char * fpath);
+int stop_router_trace();
+int get_router_trace_status();
+uint32_t get_router_trace_lost();
+// Replay => load a recorded configuration into the writer side & publish it.
+// filters[MAX_NUM_MIDI_FILTERS]: NULL items are unchanged.
+int router_trace_load_config(struct zynmidi_trace_config_st * tcfg, midi_filter_t ** filters);
 
 //-----------------------------------------------------------------------------
 // Jack MIDI Process
@@ -382,9 +855,25 @@ void zmop_push_event(struct zmop_st * zmop, jack_midi_event_t * ev); // Add even
 
 int init_jack_midi(char *name);
 int end_jack_midi();
-void populate_midi_event_from_rb(jack_ringbuffer_t *rb, jack_midi_event_t *event);
+size_t populate_midi_event_from_rb(jack_ringbuffer_t *rb, jack_midi_event_t *event, uint8_t *buffer);
 void populate_zmip_event(struct zmip_st * zmip);
+void zmip_heap_reset();
+void zmip_heap_push(int izmip);
+void zmip_heap_update_top();
 int jack_process(jack_nframes_t nframes, void *arg);
+// These are called from jack process!!
+void zmops_process_all_notes_off(struct router_config_st * cfg);
+void zmips_process_notes_release(struct router_config_st * cfg);
+void forward_zynmidi_internal(struct router_config_st * cfg);
+void zmop_all_notes_off(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg);
+void zmop_push_event(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev); // Add event to MIDI output port
+// Specialized output handlers, called from jack process!!
+zmop_output_handler_t zmop_select_output_handler(uint32_t flags, int tuning_pitchbend);
+void zmop_output_plain(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev);
+void zmop_output_noterange(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev);
+void zmop_output_chantrans(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev);
+void zmop_output_chantrans_tuning(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev);
+void zmop_output_generic(struct zmop_st * zmop, struct zmop_config_st * zmop_cfg, jack_midi_event_t * ev);
 int jack_buffer_size_change(jack_nframes_t nframes, void *arg);
 void jack_connect_cb(jack_port_id_t a, jack_port_id_t b, int connect, void *arg);
 
@@ -394,8 +883,15 @@ void jack_connect_cb(jack_port_id_t a, jack_port_id_t b, int connect, void *arg)
 
 #define JACK_MIDI_BUFFER_SIZE 16384
 
+// Direct send ring-buffer record header, followed by event data. Records are timestamped
+// with jack_frame_time() and scheduled by jack process at the same position in the next period.
+struct rb_midi_record_st {
+	uint32_t size;					// Size of event data
+	jack_nframes_t time;			// Capture time
+};
+
 // Direct Send Event Ring-Buffer write
-int write_rb_midi_event(jack_ringbuffer_t *rb, uint8_t *event_buffer, int event_size);
+int write_rb_midi_event(jack_ringbuffer_t *rb, uint8_t *event_buffer, int event_size, struct zynmidi_port_stats_st * port_stats);
 
 // ZMIP Direct Send Functions
 int zmip_send_midi_event(uint8_t iz, uint8_t *event_buffer, int event_size);
@@ -459,9 +955,41 @@ int read_zynmidi_buffer(uint32_t *buffer, int n);
 int get_zynmidi_num_max();
 int get_zynmidi_num_pending();
 
+// Size in bytes of the queue for internal events, forwarded to UI by jack process
+#define ZYNMIDI_INTERNAL_BUFFER_SIZE 4096
+
+int write_zynmidi_internal(uint32_t ev, int size);
 int write_zynmidi_note_off(uint8_t chan, uint8_t num, uint8_t val);
 int write_zynmidi_note_on(uint8_t chan, uint8_t num, uint8_t val);
 int write_zynmidi_ccontrol_change(uint8_t chan, uint8_t num, uint8_t val);
 int write_zynmidi_program_change(uint8_t chan, uint8_t num);
 
+// Typed, variable-length event records => UI
+// Each record is a header followed by the MIDI message (status + data, SysEx inline)
+
+// Size in bytes. Big enough for a full SysEx message.
+#define ZYNMIDI_RECORD_BUFFER_SIZE 65536
+
+// Which UI channels get the captured events (bitwise)
+#define ZYNMIDI_MODE_WORDS 1		// 4-bytes words => read_zynmidi_buffer()
+#define ZYNMIDI_MODE_RECORDS 2		// Records => read_zynmidi_records()
+
+// Record types
+#define ZYNMIDI_REC_MIDI 1			// MIDI message captured from a zmip
+#define ZYNMIDI_REC_MASTER 2		// MIDI message in master channel, captured from a zmip & not routed
+#define ZYNMIDI_REC_INTERNAL 3		// MIDI message generated internally (zyncoder, zynaptik, etc.)
+
+struct zynmidi_record_st {
+	uint8_t type;					// Record type
+	uint8_t izmip;					// Source zmip (0xFF for internal events)
+	uint16_t size;					// Size of MIDI message following the header
+	uint32_t time;					// Jack frame time
+};
+
+void set_zynmidi_mode(int mode);
+int get_zynmidi_mode();
+int write_zynmidi_record(uint8_t type, uint8_t izmip, uint32_t time, uint8_t *data, int size);
+int read_zynmidi_records(uint8_t *buffer, int size);	// Returns bytes read, or -(size needed) if next record doesn't fit
+int get_zynmidi_records_pending();
+
 //-----------------------------------------------------------------------------
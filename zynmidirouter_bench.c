@@ -0,0 +1,362 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: ZynMidiRouter Benchmark
+ *
+ * Run the MIDI router jack process callback in a tight loop, linked
+ * against the in-process JACK stand-in, over synthetic workloads and
+ * routing configurations. Reports ns/cycle and ns/event.
+ *
+ * Copyright (C) 2015-2024 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+#include "jack_stub.h"
+#include "zynmidirouter.h"
+
+extern struct zmip_st zmips[MAX_NUM_ZMIPS];
+extern struct zmop_st zmops[MAX_NUM_ZMOPS];
+
+#define BENCH_SAMPLE_RATE 48000
+#define BENCH_WARMUP_CYCLES 100
+
+//-----------------------------------------------------------------------------
+// Workloads => fill the input port with the events of a cycle
+//-----------------------------------------------------------------------------
+
+jack_port_t * bench_in;
+uint32_t bench_zmip_flags;	// Default flags of the input port
+jack_nframes_t bench_nframes = 256;
+uint32_t bench_cycle;
+uint32_t bench_events;		// Events injected in current cycle
+
+static void bench_midi_in(jack_nframes_t time, const uint8_t * data, size_t size) {
+	if (jack_stub_midi_in(bench_in, time, data, size) == 0)
+		bench_events++;
+}
+
+// 1 CC per frame, all channels
+void workload_cc_dense() {
+	uint8_t ev[3];
+	for (jack_nframes_t t = 0; t < bench_nframes; t++) {
+		uint32_t n = bench_cycle * bench_nframes + t;
+		ev[0] = 0xB0 | (n & 0x0F);
+		ev[1] = 1 + (n >> 4) % 32;
+		ev[2] = n & 0x7F;
+		bench_midi_in(t, ev, 3);
+	}
+}
+
+// MPE member channels 2-16: channel pressure, pitchbend & CC74 on every channel, every 32 frames
+void workload_mpe() {
+	uint8_t ev[3];
+	for (jack_nframes_t t = 0; t < bench_nframes; t += 32) {
+		uint8_t val = (bench_cycle + t) & 0x7F;
+		for (int ch = 1; ch < 16; ch++) {
+			ev[0] = 0xD0 | ch;
+			ev[1] = val;
+			bench_midi_in(t, ev, 2);
+			ev[0] = 0xE0 | ch;
+			ev[1] = val;
+			ev[2] = 0x40;
+			bench_midi_in(t, ev, 3);
+			ev[0] = 0xB0 | ch;
+			ev[1] = 74;
+			ev[2] = val;
+			bench_midi_in(t, ev, 3);
+		}
+	}
+}
+
+// MIDI clock at 300 BPM (24 ppqn), frame accurate, with a note on each beat
+void workload_clock() {
+	uint8_t ev[3];
+	uint64_t period = BENCH_SAMPLE_RATE * 60ULL / (300 * 24);
+	uint64_t start = (uint64_t)bench_cycle * bench_nframes;
+	uint64_t tick = (start + period - 1) / period;
+	for (; tick * period < start + bench_nframes; tick++) {
+		jack_nframes_t t = tick * period - start;
+		ev[0] = 0xF8;
+		bench_midi_in(t, ev, 1);
+		if (tick % 24 == 0) {
+			ev[0] = 0x99;
+			ev[1] = 36;
+			ev[2] = 100;
+			bench_midi_in(t, ev, 3);
+		} else if (tick % 24 == 12) {
+			ev[0] = 0x89;
+			ev[1] = 36;
+			ev[2] = 0;
+			bench_midi_in(t, ev, 3);
+		}
+	}
+}
+
+// 8-note chords on channel 1, note-on at cycle start & note-off at cycle middle
+void workload_chords() {
+	uint8_t ev[3];
+	uint8_t root = 36 + (bench_cycle % 48);
+	for (int i = 0; i < 8; i++) {
+		ev[0] = 0x90;
+		ev[1] = root + i * 3;
+		ev[2] = 100;
+		bench_midi_in(0, ev, 3);
+	}
+	for (int i = 0; i < 8; i++) {
+		ev[0] = 0x80;
+		ev[1] = root + i * 3;
+		ev[2] = 0;
+		bench_midi_in(bench_nframes / 2, ev, 3);
+	}
+}
+
+// SysEx burst: 4 x 256 bytes messages and a 1024 bytes message split in 4 jack events
+void workload_sysex() {
+	uint8_t ev[1024];
+	for (int i = 0; i < 1024; i++)
+		ev[i] = (bench_cycle + i) & 0x7F;
+	ev[0] = 0xF0;
+	for (int i = 0; i < 4; i++) {
+		ev[255] = 0xF7;
+		bench_midi_in(i, ev, 256);
+		ev[255] = 0x00;
+	}
+	ev[1023] = 0xF7;
+	for (int i = 0; i < 4; i++)
+		bench_midi_in(4 + i, ev + i * 256, 256);
+}
+
+struct bench_workload_st {
+	const char * name;
+	void (*fill)();
+};
+
+struct bench_workload_st workloads[] = {
+	{ "cc-dense", workload_cc_dense },
+	{ "mpe", workload_mpe },
+	{ "clock-300bpm", workload_clock },
+	{ "chords", workload_chords },
+	{ "sysex-burst", workload_sysex },
+	{ NULL, NULL }
+};
+
+//-----------------------------------------------------------------------------
+// Routing configurations => chains CH0-15 & DEV0 output are connected
+//-----------------------------------------------------------------------------
+
+static void config_reset() {
+	zmip_set_flags(ZMIP_DEV0, bench_zmip_flags);
+	for (int i = 0; i < 16; i++)
+		zmop_set_route_from(ZMOP_CH0 + i, ZMIP_DEV0, 1);
+	zmop_set_route_from(ZMOP_DEV0, ZMIP_DEV0, 0);
+	reset_midi_filter_event_map();
+	reset_midi_filter_cc_map();
+	set_tuning_freq(440.0);
+	set_global_transpose(0);
+	for (int i = 0; i < 16; i++) {
+		zmop_set_midi_chan(ZMOP_CH0 + i, i);
+		zmop_reset_note_range_transpose(ZMOP_CH0 + i);
+		zmop_set_flag_tuning(ZMOP_CH0 + i, 0);
+		zmop_set_flag_dropsysex(ZMOP_CH0 + i, 0);
+	}
+}
+
+// Active chain => every event is routed to a single chain
+void config_single() {
+	config_reset();
+	zmip_set_flag_active_chain(ZMIP_DEV0, 1);
+	set_active_chain(ZMOP_CH0);
+}
+
+// 16 chains listening all channels => every event is sent to 16 outputs
+void config_fanout() {
+	config_reset();
+	zmip_set_flag_active_chain(ZMIP_DEV0, 0);
+	for (int i = 0; i < 16; i++)
+		zmop_set_midi_chan_all(ZMOP_CH0 + i);
+}
+
+// 16 chains fan-out, with filter maps, note-range/transpose & tuning
+void config_fanout_proc() {
+	config_fanout();
+	for (int ch = 0; ch < 16; ch++) {
+		set_midi_filter_cc_map(ch, 1, ch, 11);
+		set_midi_filter_cc_ignore(ch, 2);
+	}
+	set_tuning_freq(432.0);
+	for (int i = 0; i < 16; i++) {
+		zmop_set_note_range_transpose(ZMOP_CH0 + i, 24, 96, i % 3 - 1, 0);
+		zmop_set_flag_tuning(ZMOP_CH0 + i, 1);
+	}
+}
+
+// Device to device => plain route, no processing
+void config_passthrough() {
+	config_reset();
+	zmip_set_flags(ZMIP_DEV0, 0);
+	for (int i = 0; i < 16; i++)
+		zmop_set_route_from(ZMOP_CH0 + i, ZMIP_DEV0, 0);
+	zmop_set_route_from(ZMOP_DEV0, ZMIP_DEV0, 1);
+}
+
+struct bench_config_st {
+	const char * name;
+	void (*apply)();
+};
+
+struct bench_config_st configs[] = {
+	{ "single", config_single },
+	{ "fanout16", config_fanout },
+	{ "fanout16-proc", config_fanout_proc },
+	{ "passthrough", config_passthrough },
+	{ NULL, NULL }
+};
+
+//-----------------------------------------------------------------------------
+// Benchmark
+//-----------------------------------------------------------------------------
+
+static uint64_t now_ns() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static uint64_t count_out_events() {
+	uint64_t n = 0;
+	for (int i = 0; i < MAX_NUM_ZMOPS; i++)
+		n += router_stats->zmops[i].events;
+	return n;
+}
+
+// Empty the UI buffers, so they never overflow. Not timed.
+static void drain_ui() {
+	uint32_t buffer[256];
+	while (read_zynmidi_buffer(buffer, 256) > 0);
+}
+
+void run_bench(struct bench_workload_st * wl, struct bench_config_st * conf, uint32_t n_cycles) {
+	router_config_begin();
+	conf->apply();
+	router_config_commit();
+	zmip_send_all_notes_off(ZMIP_DEV0);
+	bench_cycle = 0;
+	for (int i = 0; i < BENCH_WARMUP_CYCLES; i++) {
+		wl->fill();
+		jack_stub_cycle();
+		drain_ui();
+		bench_cycle++;
+	}
+
+	uint64_t total_ns = 0;
+	uint64_t max_ns = 0;
+	uint64_t total_events = 0;
+	uint64_t out_events = count_out_events();
+	for (uint32_t i = 0; i < n_cycles; i++) {
+		bench_events = 0;
+		wl->fill();
+		total_events += bench_events;
+		uint64_t t0 = now_ns();
+		jack_stub_cycle();
+		uint64_t dt = now_ns() - t0;
+		total_ns += dt;
+		if (dt > max_ns)
+			max_ns = dt;
+		drain_ui();
+		bench_cycle++;
+	}
+	out_events = count_out_events() - out_events;
+
+	printf("%-14s %-14s %10.1f %10.1f %10.1f %10.1f %10.1f\n", wl->name, conf->name,
+		(double)total_events / n_cycles,
+		(double)out_events / n_cycles,
+		(double)total_ns / n_cycles,
+		(double)max_ns,
+		total_events ? (double)total_ns / total_events : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t n_cycles = 10000;
+	const char * wl_filter = NULL;
+	const char * conf_filter = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "n:b:w:c:h")) != -1) {
+		switch (opt) {
+			case 'n':
+				n_cycles = atoi(optarg);
+				if (n_cycles < 1)
+					n_cycles = 1;
+				break;
+			case 'b':
+				bench_nframes = atoi(optarg);
+				if (bench_nframes < 16)
+					bench_nframes = 16;
+				break;
+			case 'w':
+				wl_filter = optarg;
+				break;
+			case 'c':
+				conf_filter = optarg;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n cycles] [-b frames] [-w workload] [-c config]\n", argv[0]);
+				fprintf(stderr, "  -n cycles: measured cycles per run (default 10000)\n");
+				fprintf(stderr, "  -b frames: jack buffer size (default 256)\n");
+				fprintf(stderr, "  -w workload: run only workloads containing this string\n");
+				fprintf(stderr, "  -c config: run only routing configs containing this string\n");
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+
+	// Private statistics => don't clash with a running router
+	router_stats_shm_name = NULL;
+	jack_stub_set_buffer_size(bench_nframes);
+	jack_stub_set_sample_rate(BENCH_SAMPLE_RATE);
+	if (!init_zynmidirouter()) {
+		fprintf(stderr, "ZynMidiRouter Bench: Can't init router!\n");
+		return 1;
+	}
+	bench_in = zmips[ZMIP_DEV0].jport;
+	bench_zmip_flags = zmip_get_flags(ZMIP_DEV0);
+	jack_stub_connect(bench_in, 1);
+	for (int i = 0; i < 16; i++)
+		jack_stub_connect(zmops[ZMOP_CH0 + i].jport, 1);
+	jack_stub_connect(zmops[ZMOP_DEV0].jport, 1);
+
+	printf("%u frames @ %u Hz, %u cycles per run\n\n", bench_nframes, BENCH_SAMPLE_RATE, n_cycles);
+	printf("%-14s %-14s %10s %10s %10s %10s %10s\n", "WORKLOAD", "CONFIG", "ev/cycle", "out/cycle", "ns/cycle", "max ns", "ns/event");
+	for (struct bench_workload_st * wl = workloads; wl->name; wl++) {
+		if (wl_filter && !strstr(wl->name, wl_filter))
+			continue;
+		for (struct bench_config_st * conf = configs; conf->name; conf++) {
+			if (conf_filter && !strstr(conf->name, conf_filter))
+				continue;
+			run_bench(wl, conf, n_cycles);
+		}
+	}
+
+	end_zynmidirouter();
+	return 0;
+}
+
+//-----------------------------------------------------------------------------
@@ -0,0 +1,288 @@
+/*
+ * ******************************************************************
+ * ZYNTHIAN PROJECT: ZynMidiRouter Trace Replay
+ *
+ * Replay a MIDI trace captured with start_router_trace through the
+ * routing code, linked against the in-process JACK stand-in, and
+ * write the resulting output streams, one line per output event:
+ *
+ *   <frame time> <zmop index>: <event bytes in hex>
+ *
+ * Replaying a trace is deterministic, so the output can be diffed
+ * against a golden file.
+ *
+ * Copyright (C) 2015-2024 Fernando Moyano <jofemodo@zynthian.org>
+ *
+ * ******************************************************************
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2 of
+ * the License, or any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * For a full copy of the GNU General Public License see the LICENSE.txt file.
+ *
+ * ******************************************************************
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jack_stub.h"
+#include "zynmidirouter.h"
+
+extern struct zmip_st zmips[MAX_NUM_ZMIPS];
+extern struct zmop_st zmops[MAX_NUM_ZMOPS];
+extern jack_client_t * jack_client;
+extern uint64_t all_notes_off_request;
+
+//-----------------------------------------------------------------------------
+// Recorded configurations => kept until jack process applied them.
+// Writers can publish several times before jack process picks the last one,
+// so records are matched by config seq.
+//-----------------------------------------------------------------------------
+
+#define MAX_PENDING 1024
+
+struct pending_config_st {
+	uint32_t seq;
+	struct zynmidi_trace_config_st * tcfg;
+	midi_filter_t * filters[MAX_NUM_MIDI_FILTERS];	// Not NULL if MIDI filter was recorded with this config
+};
+
+struct pending_config_st pending[MAX_PENDING];
+int n_pending = 0;
+
+static struct pending_config_st * get_pending(uint32_t seq) {
+	for (int i = 0; i < n_pending; i++) {
+		if (pending[i].seq == seq)
+			return pending + i;
+	}
+	if (n_pending >= MAX_PENDING) {
+		fprintf(stderr, "ZynMidiRouter Replay: Too many pending configurations!\n");
+		return NULL;
+	}
+	struct pending_config_st * pc = pending + n_pending++;
+	memset(pc, 0, sizeof(struct pending_config_st));
+	pc->seq = seq;
+	return pc;
+}
+
+static void free_pending(struct pending_config_st * pc) {
+	free(pc->tcfg);
+	for (int i = 0; i < MAX_NUM_MIDI_FILTERS; i++)
+		free(pc->filters[i]);
+	*pc = pending[--n_pending];
+}
+
+// Load the configuration with seq, including the last MIDI filters recorded up to it
+static int apply_config(uint32_t seq) {
+	struct pending_config_st * pc = NULL;
+	struct pending_config_st * pf[MAX_NUM_MIDI_FILTERS] = { NULL };
+	for (int i = 0; i < n_pending; i++) {
+		if (pending[i].seq == seq)
+			pc = pending + i;
+		for (int j = 0; j < MAX_NUM_MIDI_FILTERS; j++) {
+			if (pending[i].filters[j] && pending[i].seq <= seq && (!pf[j] || pending[i].seq > pf[j]->seq))
+				pf[j] = pending + i;
+		}
+	}
+	if (!pc || !pc->tcfg) {
+		fprintf(stderr, "ZynMidiRouter Replay: Configuration %u not found!\n", seq);
+		return 0;
+	}
+	midi_filter_t * filters[MAX_NUM_MIDI_FILTERS];
+	for (int j = 0; j < MAX_NUM_MIDI_FILTERS; j++)
+		filters[j] = pf[j] ? pf[j]->filters[j] : NULL;
+	router_trace_load_config(pc->tcfg, filters);
+	// Older configurations will never be applied
+	for (int i = n_pending - 1; i >= 0; i--) {
+		if (pending[i].seq <= seq)
+			free_pending(pending + i);
+	}
+	return 1;
+}
+
+//-----------------------------------------------------------------------------
+// Replay
+//-----------------------------------------------------------------------------
+
+FILE * fout;
+int cycle_ready = 0;
+jack_nframes_t cycle_frame;
+
+static void run_cycle() {
+	jack_stub_set_frame_time(cycle_frame);
+	jack_stub_cycle();
+
+	for (int izmop = 0; izmop < MAX_NUM_ZMOPS; izmop++) {
+		if (zmops[izmop].n_connections <= 0)
+			continue;
+		void * buffer = jack_port_get_buffer(zmops[izmop].jport, jack_get_buffer_size(jack_client));
+		uint32_t n = jack_midi_get_event_count(buffer);
+		for (uint32_t i = 0; i < n; i++) {
+			jack_midi_event_t ev;
+			if (jack_midi_event_get(&ev, buffer, i))
+				continue;
+			fprintf(fout, "%u %d:", cycle_frame + ev.time, izmop);
+			for (size_t j = 0; j < ev.size; j++)
+				fprintf(fout, " %02X", ev.buffer[j]);
+			fprintf(fout, "\n");
+		}
+	}
+
+	// UI buffers are not replayed => keep them empty
+	uint32_t words[256];
+	uint8_t records[4096];
+	while (read_zynmidi_buffer(words, 256) > 0);
+	while (read_zynmidi_records(records, sizeof(records)) > 0);
+	cycle_ready = 0;
+}
+
+int main(int argc, char *argv[]) {
+	const char * fpath_out = NULL;
+	int opt;
+	while ((opt = getopt(argc, argv, "o:h")) != -1) {
+		switch (opt) {
+			case 'o':
+				fpath_out = optarg;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-o output] trace_file\n", argv[0]);
+				fprintf(stderr, "  -o output: write output streams to file (default stdout)\n");
+				return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind >= argc) {
+		fprintf(stderr, "Usage: %s [-o output] trace_file\n", argv[0]);
+		return 1;
+	}
+
+	FILE * fin = fopen(argv[optind], "rb");
+	if (!fin) {
+		fprintf(stderr, "ZynMidiRouter Replay: Can't open trace file '%s'.\n", argv[optind]);
+		return 1;
+	}
+	struct zynmidi_trace_header_st header;
+	if (fread(&header, sizeof(header), 1, fin) != 1 || memcmp(header.magic, ZYNMIDI_TRACE_MAGIC, 4) || header.version != ZYNMIDI_TRACE_VERSION) {
+		fprintf(stderr, "ZynMidiRouter Replay: Bad trace file format.\n");
+		return 1;
+	}
+	if (header.num_zmips != MAX_NUM_ZMIPS || header.num_zmops != MAX_NUM_ZMOPS || header.config_size != sizeof(struct zynmidi_trace_config_st)) {
+		fprintf(stderr, "ZynMidiRouter Replay: Trace was recorded by an incompatible router version.\n");
+		return 1;
+	}
+	fout = stdout;
+	if (fpath_out) {
+		fout = fopen(fpath_out, "w");
+		if (!fout) {
+			fprintf(stderr, "ZynMidiRouter Replay: Can't open output file '%s'.\n", fpath_out);
+			return 1;
+		}
+	}
+
+	// Private statistics => don't clash with a running router
+	router_stats_shm_name = NULL;
+	if (header.buffer_size)
+		jack_stub_set_buffer_size(header.buffer_size);
+	if (header.sample_rate)
+		jack_stub_set_sample_rate(header.sample_rate);
+	if (!init_zynmidirouter()) {
+		fprintf(stderr, "ZynMidiRouter Replay: Can't init router!\n");
+		return 1;
+	}
+	// Direct inputs have no jack port => give them one, so recorded events can be injected
+	for (int izmip = 0; izmip < MAX_NUM_ZMIPS; izmip++) {
+		if (!zmips[izmip].jport)
+			zmips[izmip].jport = jack_port_register(jack_client, "replay_in", JACK_DEFAULT_MIDI_TYPE, JackPortIsInput, 0);
+	}
+
+	struct zynmidi_trace_record_st rec;
+	uint8_t * data = malloc(0x10000);
+	uint32_t n_cycles = 0;
+	uint32_t n_events = 0;
+	uint32_t n_lost = 0;
+	while (fread(&rec, sizeof(rec), 1, fin) == 1) {
+		if (rec.size && fread(data, rec.size, 1, fin) != 1) {
+			fprintf(stderr, "ZynMidiRouter Replay: Truncated trace file.\n");
+			break;
+		}
+		struct pending_config_st * pc;
+		switch (rec.type) {
+			case ZYNMIDI_TRACE_CYCLE:
+				if (cycle_ready)
+					run_cycle();
+				cycle_frame = rec.time;
+				jack_stub_set_buffer_size(*(uint32_t *)data);
+				cycle_ready = 1;
+				n_cycles++;
+				break;
+			case ZYNMIDI_TRACE_EVENT:
+				if (rec.izmip < MAX_NUM_ZMIPS && zmips[rec.izmip].jport) {
+					jack_stub_midi_in(zmips[rec.izmip].jport, rec.time, data, rec.size);
+					n_events++;
+				}
+				break;
+			case ZYNMIDI_TRACE_ALL_NOTES_OFF:
+				__atomic_fetch_or(&all_notes_off_request, *(uint64_t *)data, __ATOMIC_RELEASE);
+				break;
+			case ZYNMIDI_TRACE_CONFIG:
+				pc = get_pending(rec.time);
+				if (pc) {
+					pc->tcfg = malloc(sizeof(struct zynmidi_trace_config_st));
+					memcpy(pc->tcfg, data, sizeof(struct zynmidi_trace_config_st));
+				}
+				break;
+			case ZYNMIDI_TRACE_FILTER:
+				pc = get_pending(rec.time);
+				if (pc && rec.izmip < MAX_NUM_MIDI_FILTERS * 8 && rec.size == sizeof(midi_filter_t) / 8) {
+					midi_filter_t ** filter = pc->filters + rec.izmip / 8;
+					if (!*filter)
+						*filter = calloc(1, sizeof(midi_filter_t));
+					memcpy((*filter)->event_map[rec.izmip % 8], data, rec.size);
+				}
+				break;
+			case ZYNMIDI_TRACE_CONFIG_APPLY:
+				apply_config(rec.time);
+				break;
+			case ZYNMIDI_TRACE_LOST:
+				n_lost += rec.time;
+				break;
+			case ZYNMIDI_TRACE_NOTES:
+				// Held notes at trace start => note-offs & all-notes-off work as recorded
+				if (rec.izmip < MAX_NUM_ZMOPS && rec.size == sizeof(zmops[0].note_bits)) {
+					struct zmop_st * zmop = zmops + rec.izmip;
+					memcpy(zmop->note_bits, data, rec.size);
+					zmop->note_chans = 0;
+					for (int chan = 0; chan < 16; chan++) {
+						if (zmop->note_bits[chan][0] | zmop->note_bits[chan][1])
+							zmop->note_chans |= 1 << chan;
+					}
+				}
+				break;
+		}
+	}
+	if (cycle_ready)
+		run_cycle();
+	fclose(fin);
+	if (fout != stdout)
+		fclose(fout);
+	free(data);
+	while (n_pending > 0)
+		free_pending(pending);
+
+	fprintf(stderr, "ZynMidiRouter Replay: %u cycles, %u events replayed.\n", n_cycles, n_events);
+	if (n_lost)
+		fprintf(stderr, "ZynMidiRouter Replay: Trace lost %u records while capturing. Replay is not faithful!\n", n_lost);
+	end_zynmidirouter();
+	return 0;
+}
+
+//-----------------------------------------------------------------------------